@@ -16,7 +16,8 @@
 
 #define ETH_BUFFER_SIZE (1536UL)
 
-uint8_t ETHBuffer[(ETH_RX_DESC_CNT + ETH_TX_DESC_CNT) * ETH_BUFFER_SIZE] __attribute__((section(".ETHBufferSection"))); /* Ethernet Receive Buffers */
+// packets are transmitted directly from their EtherLib buffers, no TX bounce buffers are needed
+uint8_t ETHBuffer[ETH_RX_DESC_CNT * ETH_BUFFER_SIZE] __attribute__((section(".ETHBufferSection"))); /* Ethernet Receive Buffers */
 
 struct {
     ETHHW_State ETHState;
@@ -24,6 +25,152 @@ struct {
     ETHHW_DescFull DMATxDscrTab[ETH_TX_DESC_CNT];
 } ETHStateAndDesc __attribute__((section(".ETHStateAndDecripSection")));
 
+// -------------------------------------
+// ---------- TX overflow queue --------
+// -------------------------------------
+
+#define ETH_TX_QUEUE_LEN (16) // packets waiting for a TX descriptor
+
+static ETHHW_TxQueueItem txQueue[ETH_TX_QUEUE_LEN];
+
+// buffers released by the MAC driver, which does so with interrupts disabled, freed afterwards in task context
+// since dynmem_free() is not interrupt-safe; at most every packet in the ring and in the queue is waiting here
+// (length MUST be a power of 2)
+#define ETH_TX_DEFERRED_LEN (ETH_TX_DESC_CNT + ETH_TX_QUEUE_LEN)
+
+_Static_assert((ETH_TX_DEFERRED_LEN & (ETH_TX_DEFERRED_LEN - 1)) == 0, "ETH_TX_DEFERRED_LEN must be a power of 2");
+
+static void *txDeferred[ETH_TX_DEFERRED_LEN];
+static volatile uint16_t txDeferredWr = 0, txDeferredRd = 0; // free-running indices
+
+// free the buffers parked by the release events (task context, interrupts enabled)
+static void ethdrv_free_deferred() {
+    while (txDeferredRd != txDeferredWr) {
+        dynmem_free(txDeferred[txDeferredRd % ETH_TX_DEFERRED_LEN]);
+        txDeferredRd++;
+    }
+}
+
+// free transmitted packets
+static void ethdrv_release_tx() {
+    ETHHW_ReleaseTx(ETH);
+    ethdrv_free_deferred();
+}
+
+// -------------------------------------
+// -------- RX buffer loaning ----------
+// -------------------------------------
+
+#define ETH_RX_SPARE_CNT (8) // number of spare RX buffers re-arming the descriptors of loaned ones
+#define ETH_RX_POLL_BUDGET (8) // maximum number of packets processed by a single read
+
+uint8_t ETHRxSpareBuffer[ETH_RX_SPARE_CNT * ETH_BUFFER_SIZE] __attribute__((section(".ETHBufferSection"))); /* Spare Ethernet Receive Buffers */
+
+// at most ETH_RX_SPARE_CNT buffers are off the ring at any time
+static uint8_t *rxFreeBufs[ETH_RX_SPARE_CNT]; // free RX buffers (LIFO)
+static uint16_t rxFreeCnt = 0;                // number of free RX buffers
+
+static bool rxLoanEn = true;      // loan mode is enabled
+static EthDrv_RxStats rxStats;    // reception statistics
+
+// check if the buffer is an RX buffer (either from the ring or a spare one)
+static bool ethdrv_is_rx_buf(const void *ptr) {
+    const uint8_t *p = (const uint8_t *)ptr;
+    return ((p >= ETHBuffer) && (p < (ETHBuffer + ETH_RX_DESC_CNT * ETH_BUFFER_SIZE))) ||
+           ((p >= ETHRxSpareBuffer) && (p < (ETHRxSpareBuffer + sizeof(ETHRxSpareBuffer))));
+}
+
+static void ethdrv_init_rx_pool() {
+    for (uint16_t i = 0; i < ETH_RX_SPARE_CNT; i++) {
+        rxFreeBufs[i] = ETHRxSpareBuffer + i * ETH_BUFFER_SIZE;
+    }
+    rxFreeCnt = ETH_RX_SPARE_CNT;
+    memset(&rxStats, 0, sizeof(EthDrv_RxStats));
+    rxStats.minFree = ETH_RX_SPARE_CNT;
+}
+
+// take a free RX buffer, return NULL if the pool is empty
+static uint8_t *ethdrv_take_rx_buf() {
+    uint8_t *buf = NULL;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (rxFreeCnt > 0) {
+        buf = rxFreeBufs[--rxFreeCnt];
+        if (rxFreeCnt < rxStats.minFree) {
+            rxStats.minFree = rxFreeCnt;
+        }
+    }
+    __set_PRIMASK(primask);
+
+    return buf;
+}
+
+// put a loaned RX buffer back into the pool
+static void ethdrv_give_rx_buf(const void *ptr) {
+    // round to the buffer start in case the payload pointer has been advanced
+    const uint8_t *p = (const uint8_t *)ptr;
+    uint8_t *base = ((p >= ETHRxSpareBuffer) && (p < (ETHRxSpareBuffer + sizeof(ETHRxSpareBuffer)))) ? ETHRxSpareBuffer : ETHBuffer;
+    uint8_t *buf = base + ((p - base) / ETH_BUFFER_SIZE) * ETH_BUFFER_SIZE;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    rxFreeBufs[rxFreeCnt++] = buf;
+    rxStats.returned++;
+    __set_PRIMASK(primask);
+}
+
+// EtherLib releases every packet payload through dynmem_free(), the linker redirects
+// those calls here (-Wl,--wrap=dynmem_free) so that loaned RX buffers return to the pool
+void __real_dynmem_free(const void *ptr);
+
+void __wrap_dynmem_free(const void *ptr) {
+    if (ethdrv_is_rx_buf(ptr)) {
+        ethdrv_give_rx_buf(ptr);
+    } else {
+        __real_dynmem_free(ptr);
+    }
+}
+
+void ethdrv_set_rx_loan(bool en) {
+    rxLoanEn = en;
+}
+
+bool ethdrv_get_rx_loan() {
+    return rxLoanEn;
+}
+
+const EthDrv_RxStats *ethdrv_get_rx_stats() {
+    return &rxStats;
+}
+
+// -------------------------------------
+// ----- TX timestamp dispatching ------
+// -------------------------------------
+
+#define ETH_TXTS_FLAG (0x01) // TX timestamps are waiting
+
+static osThreadId_t txTsTh = NULL;
+
+// invoke TX timestamp callbacks outside the ETH interrupt
+static void txts_thread(void *arg) {
+    while (true) {
+        osThreadFlagsWait(ETH_TXTS_FLAG, osFlagsWaitAny, osWaitForever);
+        ETHHW_DispatchTxTimestamps(ETH);
+    }
+}
+
+static void ethdrv_start_txts_dispatcher() {
+    osThreadAttr_t attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.stack_size = 2048;
+    attr.name = "txts";
+    attr.priority = osPriorityHigh;
+    txTsTh = osThreadNew(txts_thread, NULL, &attr);
+
+    ETHHW_SetTxTsInIsr(ETH, false);
+}
+
 // -------------------------------------
 // ---------- Global objects -----------
 // -------------------------------------
@@ -84,6 +231,8 @@ static void phy_thread(void *arg) {
 void ethdrv_init() {
     // ------- Ethernet MAC initialization -----
 
+    ethdrv_init_rx_pool();
+
     ETHHW_InitOpts opts = {
         .statePtr = &(ETHStateAndDesc.ETHState),
 
@@ -94,10 +243,15 @@ void ethdrv_init() {
         .txRingLen = ETH_TX_DESC_CNT,
         .txRingPtr = (uint8_t *)ETHStateAndDesc.DMATxDscrTab,
         .blockSize = ETH_BUFFER_SIZE,
+        .noTxBufs = true,
+        .txQueuePtr = txQueue,
+        .txQueueLen = ETH_TX_QUEUE_LEN,
         .mac = {ETH_MAC_ADDR0, ETH_MAC_ADDR1, ETH_MAC_ADDR2, ETH_MAC_ADDR3, ETH_MAC_ADDR4, ETH_MAC_ADDR5}};
 
     ETHHW_Init(ETH, &opts);
 
+    ethdrv_start_txts_dispatcher();
+
     ETHHW_Start(ETH);
 
     // -------- IODef initialization -----------
@@ -117,8 +271,42 @@ void ethdrv_init() {
     th = osThreadNew(phy_thread, NULL, &attr);
 }
 
+const LinkState *ethdrv_get_link_state() {
+    return &linkState;
+}
+
+// map an IPv4 multicast group to its MAC address
+static void ethdrv_group_to_mac(uint32_t group, uint8_t *mac) {
+    const uint8_t *ip = (const uint8_t *)&group; // first octet is stored first
+    mac[0] = 0x01;
+    mac[1] = 0x00;
+    mac[2] = 0x5E;
+    mac[3] = ip[1] & 0x7F;
+    mac[4] = ip[2];
+    mac[5] = ip[3];
+}
+
+bool ethdrv_join_group(uint32_t group) {
+    uint8_t mac[6];
+    ethdrv_group_to_mac(group, mac);
+    return ETHHW_AddMulticastFilter(ETH, mac);
+}
+
+bool ethdrv_leave_group(uint32_t group) {
+    uint8_t mac[6];
+    ethdrv_group_to_mac(group, mac);
+    return ETHHW_RemoveMulticastFilter(ETH, mac);
+}
+
 int ethdrv_read() {
-    ETHHW_ProcessRx(ETH);
+    ethdrv_release_tx();
+
+    // process a limited number of packets, come back later if more are waiting
+    if (!ETHHW_PollRx(ETH, ETH_RX_POLL_BUDGET)) {
+        if (ioDef.llRxNotify != NULL) {
+            ioDef.llRxNotify(&ioDef);
+        }
+    }
     return 0;
 }
 
@@ -128,29 +316,41 @@ int ETHHW_ReadCallback(ETHHW_EventDesc *evt) {
         return 0;
     }
 
-    // allocate raw buffer
     RawPckt pckt;
     uint16_t size = evt->data.rx.size;
-    uint8_t *plBuf = dynmem_alloc(size);
-    if (plBuf == NULL) {
-        MSG("malloc failed in ethdrv_input()!");
-        return 0; // processing failed
+    int ret = ETHHW_RET_RX_PROCESSED;
+
+    // try to loan the DMA buffer itself
+    uint8_t *spare = rxLoanEn ? ethdrv_take_rx_buf() : NULL;
+    if (spare != NULL) {
+        pckt.payload = evt->data.rx.payload;
+        evt->data.rx.spare = spare; // re-arm the descriptor with the spare buffer
+        ret = ETHHW_RET_RX_LOANED;
+        rxStats.loaned++;
+    } else {
+        // allocate raw buffer
+        uint8_t *plBuf = dynmem_alloc(size);
+        if (plBuf == NULL) {
+            MSG("malloc failed in ethdrv_input()!");
+            return 0; // processing failed
+        }
+
+        // copy data
+        memcpy(plBuf, evt->data.rx.payload, size); // copy payload
+        pckt.payload = plBuf;
+        rxStats.copied++;
     }
 
     // fill-in packet data
-    pckt.payload = plBuf;
     pckt.size = size;
     pckt.ext.rx.time_s = evt->data.rx.ts_s;
     pckt.ext.rx.time_ns = evt->data.rx.ts_ns;
 
-    // copy data
-    memcpy(pckt.payload, evt->data.rx.payload, size); // copy payload
-
     if (ioDef.llRxStore != NULL) {
         ioDef.llRxStore(&ioDef, &pckt);
     }
 
-    return ETHHW_RET_RX_PROCESSED;
+    return ret;
 }
 
 int ETHHW_EventCallback(ETHHW_EventDesc *evt) {
@@ -158,40 +358,52 @@ int ETHHW_EventCallback(ETHHW_EventDesc *evt) {
         if (ioDef.llRxNotify != NULL) {
             ioDef.llRxNotify(&ioDef);
         }
+    } else if (evt->type == ETHHW_EVT_TX_TS_READY) {
+        osThreadFlagsSet(txTsTh, ETH_TXTS_FLAG);
+        return 1;
+    } else if (evt->type == ETHHW_EVT_TX_RELEASE) {
+        // the DMA has finished with the packet, interrupts are disabled here: park it to be freed later
+        txDeferred[txDeferredWr % ETH_TX_DEFERRED_LEN] = evt->data.txRelease.buf;
+        txDeferredWr++;
+        return 1;
     }
 
     return 0; // unhandled event
 }
 
 int ethdrv_output(const RawPckt *pckt) {
-    // check if timestamping is demanded
-    uint8_t opts = ETHHW_TXOPT_NONE;
+    // check if timestamping is demanded, the payload is transmitted in place
+    uint8_t opts = ETHHW_TXOPT_ZERO_COPY;
     bool tsEn = (pckt->ext.tx.txTsCb != NULL);
     ETHHW_OptArg_TxTsCap optArg;
 
     if (tsEn) {
-        opts = ETHHW_TXOPT_CAPTURE_TS;
+        opts |= ETHHW_TXOPT_CAPTURE_TS;
         optArg.txTsCbPtr = (uint32_t)pckt->ext.tx.txTsCb;
         optArg.tag = pckt->ext.tx.arg;
     }
 
-    // transmit
-    ETHHW_Transmit(ETH, pckt->payload, pckt->size, opts, &optArg);
-
-    return 0;
+    // transmit (never blocks, a full ring is reported back)
+    return ETHHW_Transmit(ETH, pckt->payload, pckt->size, opts, &optArg);
 }
 
 int ethdrv_send(EthIODef *io, MsgQueue *mq) {
     uint32_t bytes_sent = 0;
+    ethdrv_release_tx();
+
     if (mq_avail(mq) > 0) {
         RawPckt pckt = mq_top(mq);
         mq_pop(mq);
         int ret = ethdrv_output(&pckt);
-        if (ret != 0) {
-            MSG("Tx ERROR!\n");
+        ethdrv_free_deferred(); // the descriptor may have handed back its previous buffer
+        if (ret < 0) {
+            if (ret == ETHHW_TX_ERROR) {
+                MSG("Tx ERROR!\n");
+            }
+            dynmem_free(pckt.payload); // packet has not been accepted (a full ring is counted by the MAC driver)
+        } else {
+            bytes_sent += pckt.size; // payload is freed once transmitted
         }
-        bytes_sent += pckt.size;
-        dynmem_free(pckt.payload);
         // MSGraw("TX\r\n");
     }
     return (int)bytes_sent;
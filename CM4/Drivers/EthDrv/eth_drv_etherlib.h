@@ -4,6 +4,7 @@
 #include <etherlib/packet.h>
 #include <etherlib/msg_queue.h>
 
+#include <stdbool.h>
 #include <stdint.h>
 
 typedef struct {
@@ -13,14 +14,29 @@ typedef struct {
     bool duplex;
 } LinkState;
 
+typedef struct {
+    uint32_t loaned;   // frames handed over in their DMA buffer
+    uint32_t copied;   // frames copied into a dynamically allocated buffer (loaning disabled or pool empty)
+    uint32_t returned; // loaned buffers returned to the pool
+    uint16_t minFree;  // lowest number of free spare buffers
+} EthDrv_RxStats;
+
 struct EthInterface_;
 struct EthIODef_;
 
 void ethdrv_init();
 int ethdrv_input(RawPckt * pckt);
-int ethdrv_output(const RawPckt * pckt);
+int ethdrv_output(const RawPckt * pckt); // the payload is transmitted in place and freed by the driver afterwards, returns an ETHHW_TxStatus (negative: not accepted, the payload is left to the caller)
 
 int ethdrv_send(struct EthIODef_ * io, MsgQueue * mq);
 struct EthIODef_ * ethdrv_get();
+const LinkState * ethdrv_get_link_state();
+
+void ethdrv_set_rx_loan(bool en); // enable or disable passing RX DMA buffers to EtherLib without copying
+bool ethdrv_get_rx_loan();
+const EthDrv_RxStats * ethdrv_get_rx_stats();
+
+bool ethdrv_join_group(uint32_t group);  // let the frames of an IPv4 multicast group (EtherLib ip4_addr byte order) in, call along with joining the group in EtherLib
+bool ethdrv_leave_group(uint32_t group); // stop receiving an IPv4 multicast group, call along with leaving the group in EtherLib
 
 #endif /* ETHDRV_ETH_DRV_ETHERLIB */
@@ -26,6 +26,7 @@
 #include "lwip/pbuf.h"
 #include "lwip/snmp.h"
 #include "lwip/stats.h"
+#include "netif/ethernet.h"
 #include "netif/ppp/pppoe.h"
 #include "standard_output/standard_output.h"
 
@@ -39,9 +40,9 @@
 
 #define ETH_BUFFER_SIZE (1528UL)
 #define ETH_RX_BUF_SIZE (ETH_BUFFER_SIZE)
-#define ETH_TX_BUF_SIZE (ETH_BUFFER_SIZE)
 
-uint8_t ETHBuffer[(ETH_RX_DESC_CNT + ETH_TX_DESC_CNT) * ETH_BUFFER_SIZE] __attribute__((section(".ETHBufferSection"))); /* Ethernet Receive Buffers */
+// pbufs are transmitted in place (ETHHW_TransmitSG()), no TX bounce buffers are needed
+uint8_t ETHBuffer[ETH_RX_DESC_CNT * ETH_BUFFER_SIZE] __attribute__((section(".ETHBufferSection"))); /* Ethernet Receive Buffers */
 
 struct {
     ETHHW_State ETHState;
@@ -49,6 +50,105 @@ struct {
     ETHHW_DescFull DMATxDscrTab[ETH_TX_DESC_CNT];
 } ETHStateAndDesc __attribute__((section(".ETHStateAndDecripSection")));
 
+// -------------------------------------
+// ------- Zero-copy RX buffers --------
+// -------------------------------------
+
+#define ETH_RX_SPARE_CNT (8)                                  // number of spare RX buffers re-arming the descriptors of buffers passed to lwIP
+#define ETH_RX_BUF_TOTAL_CNT (ETH_RX_DESC_CNT + ETH_RX_SPARE_CNT) // total number of RX buffers
+
+uint8_t ETHRxSpareBuffer[ETH_RX_SPARE_CNT * ETH_RX_BUF_SIZE] __attribute__((section(".ETHBufferSection"))); /* Spare Ethernet Receive Buffers */
+
+// custom pbuf wrapping an RX buffer
+typedef struct {
+    struct pbuf_custom pc; // lwIP custom pbuf, MUST be the first member
+    uint8_t *buf;          // wrapped DMA buffer
+} EthRxPbuf;
+
+static EthRxPbuf rxPbufs[ETH_RX_BUF_TOTAL_CNT]; // one custom pbuf for each RX buffer
+
+// at most ETH_RX_SPARE_CNT buffers are off the ring at any time
+static uint8_t *rxFreeBufs[ETH_RX_SPARE_CNT]; // free RX buffers (LIFO) replenishing the descriptors
+static uint16_t rxFreeCnt = 0;                // number of free RX buffers
+
+// get the custom pbuf belonging to an RX buffer
+static EthRxPbuf *ethdrv_get_rx_pbuf(const uint8_t *buf) {
+    uint16_t i;
+    if ((buf >= ETHRxSpareBuffer) && (buf < (ETHRxSpareBuffer + sizeof(ETHRxSpareBuffer)))) {
+        i = ETH_RX_DESC_CNT + (buf - ETHRxSpareBuffer) / ETH_RX_BUF_SIZE;
+    } else {
+        i = (buf - ETHBuffer) / ETH_RX_BUF_SIZE;
+    }
+    return &rxPbufs[i];
+}
+
+// take a free RX buffer, return NULL if the pool is empty (might be called from interrupt context)
+static uint8_t *ethdrv_take_rx_buf() {
+    uint8_t *buf = NULL;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (rxFreeCnt > 0) {
+        buf = rxFreeBufs[--rxFreeCnt];
+    }
+    __set_PRIMASK(primask);
+
+    return buf;
+}
+
+// put an RX buffer back into the pool
+static void ethdrv_give_rx_buf(uint8_t *buf) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    rxFreeBufs[rxFreeCnt++] = buf;
+    __set_PRIMASK(primask);
+}
+
+// release a custom pbuf, its buffer goes back to the pool
+static void ethdrv_free_rx_pbuf(struct pbuf *p) {
+    ethdrv_give_rx_buf(((EthRxPbuf *)p)->buf);
+}
+
+static void ethdrv_init_rx_pool() {
+    for (uint16_t i = 0; i < ETH_RX_BUF_TOTAL_CNT; i++) {
+        EthRxPbuf *rp = &rxPbufs[i];
+        rp->pc.custom_free_function = ethdrv_free_rx_pbuf;
+        rp->buf = (i < ETH_RX_DESC_CNT) ? (ETHBuffer + i * ETH_RX_BUF_SIZE) : (ETHRxSpareBuffer + (i - ETH_RX_DESC_CNT) * ETH_RX_BUF_SIZE);
+    }
+
+    for (uint16_t i = 0; i < ETH_RX_SPARE_CNT; i++) {
+        rxFreeBufs[i] = ETHRxSpareBuffer + i * ETH_RX_BUF_SIZE;
+    }
+    rxFreeCnt = ETH_RX_SPARE_CNT;
+}
+
+// -------------------------------------
+// ----- TX timestamp dispatching ------
+// -------------------------------------
+
+#define ETH_TXTS_FLAG (0x01) // TX timestamps are waiting
+
+static osThreadId_t txTsTh = NULL;
+
+// invoke TX timestamp callbacks outside the ETH interrupt
+static void txts_thread(void *arg) {
+    while (true) {
+        osThreadFlagsWait(ETH_TXTS_FLAG, osFlagsWaitAny, osWaitForever);
+        ETHHW_DispatchTxTimestamps(ETH);
+    }
+}
+
+static void ethdrv_start_txts_dispatcher() {
+    osThreadAttr_t attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.stack_size = 2048;
+    attr.name = "txts";
+    attr.priority = osPriorityHigh;
+    txTsTh = osThreadNew(txts_thread, NULL, &attr);
+
+    ETHHW_SetTxTsInIsr(ETH, false);
+}
+
 // -------------------------------------
 // ---------- Global objects -----------
 // -------------------------------------
@@ -101,12 +201,34 @@ static void phy_thread(void *arg) {
 
 // ------------------------------
 
+#define ETH_TX_MAX_SEGS (8) // maximum number of pbufs in a chain transmitted without copying
+
+static struct pbuf *txPbufs[ETH_TX_DESC_CNT]; // pbufs being transmitted, indexed by their last TX descriptor
+
+/**
+ * Free the pbufs whose transmission has been completed by the DMA.
+ * Called in the tcpip thread, since pbuf_free() must not be called from the interrupt.
+ */
+static void low_level_reclaim_tx() {
+    for (u16_t i = 0; i < ETH_TX_DESC_CNT; i++) {
+        if ((txPbufs[i] != NULL) && ETHHW_IsTxDescReleased(ETH, i)) {
+            pbuf_free(txPbufs[i]);
+            txPbufs[i] = NULL;
+        }
+    }
+}
+
 /* Define those to better describe your network interface. */
 #define IFNAME0 'i'
 #define IFNAME1 '0'
 
 /* Forward declarations. */
 static void ethernetif_input(struct netif *netif);
+static void ethernetif_poll(void *arg);
+
+#define ETH_RX_POLL_BUDGET (8) // maximum number of packets processed by a single poll round
+
+static struct tcpip_callback_msg *rxPollMsg = NULL; // preallocated message scheduling the RX poll in the tcpip thread
 
 /**
  * In this function, the hardware should be initialized.
@@ -118,6 +240,10 @@ static void ethernetif_input(struct netif *netif);
 static void low_level_init(struct netif *netif) {
     // ------- Ethernet MAC initialization -----
 
+    ethdrv_init_rx_pool();
+
+    rxPollMsg = tcpip_callbackmsg_new(ethernetif_poll, netif);
+
     ETHHW_InitOpts opts = {
         .statePtr = &(ETHStateAndDesc.ETHState),
 
@@ -128,10 +254,13 @@ static void low_level_init(struct netif *netif) {
         .txRingLen = ETH_TX_DESC_CNT,
         .txRingPtr = (uint8_t *)ETHStateAndDesc.DMATxDscrTab,
         .blockSize = ETH_BUFFER_SIZE,
+        .noTxBufs = true,
         .mac = {ETH_MAC_ADDR0, ETH_MAC_ADDR1, ETH_MAC_ADDR2, ETH_MAC_ADDR3, ETH_MAC_ADDR4, ETH_MAC_ADDR5}};
 
     ETHHW_Init(ETH, &opts);
 
+    ethdrv_start_txts_dispatcher();
+
     ETHHW_Start(ETH);
 
     // -------- Process PHY events occured during the initialization phase
@@ -174,6 +303,40 @@ static void low_level_init(struct netif *netif) {
     /* Do whatever else is needed to initialize interface. */
 }
 
+/**
+ * Add or remove a multicast MAC address to/from the hardware filter.
+ */
+static err_t ethernetif_mac_filter(const u8_t *mac, enum netif_mac_filter_action action) {
+    bool ok;
+    if (action == NETIF_ADD_MAC_FILTER) {
+        ok = ETHHW_AddMulticastFilter(ETH, mac);
+    } else {
+        ok = ETHHW_RemoveMulticastFilter(ETH, mac);
+    }
+    return ok ? ERR_OK : ERR_IF;
+}
+
+#if LWIP_IPV4 && LWIP_IGMP
+/**
+ * Let the frames of a joined IPv4 multicast group in (igmp_mac_filter).
+ */
+static err_t ethernetif_igmp_mac_filter(struct netif *netif, const ip4_addr_t *group, enum netif_mac_filter_action action) {
+    u8_t mac[6] = {0x01, 0x00, 0x5E, ip4_addr2(group) & 0x7F, ip4_addr3(group), ip4_addr4(group)};
+    return ethernetif_mac_filter(mac, action);
+}
+#endif /* LWIP_IPV4 && LWIP_IGMP */
+
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+/**
+ * Let the frames of a joined IPv6 multicast group in (mld_mac_filter).
+ */
+static err_t ethernetif_mld_mac_filter(struct netif *netif, const ip6_addr_t *group, enum netif_mac_filter_action action) {
+    u32_t low = lwip_ntohl(group->addr[3]);
+    u8_t mac[6] = {0x33, 0x33, (u8_t)(low >> 24), (u8_t)(low >> 16), (u8_t)(low >> 8), (u8_t)low};
+    return ethernetif_mac_filter(mac, action);
+}
+#endif /* LWIP_IPV6 && LWIP_IPV6_MLD */
+
 /**
  * This function should do the actual transmission of the packet. The packet is
  * contained in the pbuf that is passed to the function. This pbuf
@@ -191,20 +354,43 @@ static void low_level_init(struct netif *netif) {
  */
 static err_t low_level_output(struct netif *netif, struct pbuf *p) {
     struct pbuf *q;
-    static u8_t concat_buf[ETH_TX_BUF_SIZE];
-    u32_t concat_buf_level = 0;
+    ETHHW_Segment segs[ETH_TX_MAX_SEGS];
+    u16_t n = 0;
+
+    /* release pbufs the DMA has finished with */
+    low_level_reclaim_tx();
 
 #if ETH_PAD_SIZE
     pbuf_remove_header(p, ETH_PAD_SIZE); /* drop the padding word */
 #endif
 
-    /* Concat pbufs into a single buffer */
-    for (q = p; q != NULL; q = q->next) {
-        /* Send the data from the pbuf to the interface, one pbuf at a
-           time. The size of the data in each pbuf is kept in the ->len
-           variable. */
-        memcpy(concat_buf + concat_buf_level, q->payload, q->len);
-        concat_buf_level += q->len;
+    /* collect the pbufs of the chain as DMA segments */
+    struct pbuf *txp = p;
+    bool needsCopy = false;
+    for (q = p; (q != NULL) && (n < ETH_TX_MAX_SEGS); q = q->next) {
+        segs[n].buf = q->payload;
+        segs[n].len = q->len;
+        needsCopy |= PBUF_NEEDS_COPY(q); /* PBUF_REF/ROM payload may change once we return */
+        n++;
+    }
+
+    if ((q != NULL) || needsCopy) {
+        /* chain is too long or refers to volatile data, transmit a contiguous copy of it */
+        txp = pbuf_clone(PBUF_RAW, PBUF_RAM, p);
+        if (txp == NULL) {
+            LINK_STATS_INC(link.memerr);
+            LINK_STATS_INC(link.drop);
+            MIB2_STATS_NETIF_INC(netif, ifoutdiscards);
+#if ETH_PAD_SIZE
+            pbuf_add_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
+#endif
+            return ERR_MEM;
+        }
+        segs[0].buf = txp->payload;
+        segs[0].len = txp->len;
+        n = 1;
+    } else {
+        pbuf_ref(p); /* the DMA reads the pbufs directly, keep them until transmitted */
     }
 
     /* check if timestamping is demanded */
@@ -219,8 +405,28 @@ static err_t low_level_output(struct netif *netif, struct pbuf *p) {
         optArg.tag = (uint32_t)p->tag;
     }
 
-    /* Pass the data to the MAC */
-    ETHHW_Transmit(ETH, concat_buf, concat_buf_level, opts, &optArg);
+    /* Pass the segments to the MAC */
+    int lastIdx = ETHHW_TransmitSG(ETH, segs, n, opts, &optArg);
+    if (lastIdx >= 0) {
+        if (txPbufs[lastIdx] != NULL) {
+            pbuf_free(txPbufs[lastIdx]); /* descriptor has been reused, so its previous packet is surely done */
+        }
+        txPbufs[lastIdx] = txp; /* released once the last descriptor is done */
+    } else {
+        pbuf_free(txp);
+        if (lastIdx == ETHHW_TX_RING_FULL) {
+            /* let the stack back off instead of spinning on the ring */
+            LINK_STATS_INC(link.memerr);
+            LINK_STATS_INC(link.drop);
+            MIB2_STATS_NETIF_INC(netif, ifoutdiscards);
+#if ETH_PAD_SIZE
+            pbuf_add_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
+#endif
+            return ERR_MEM;
+        }
+        LINK_STATS_INC(link.err);
+        MIB2_STATS_NETIF_INC(netif, ifouterrors);
+    }
 
     MIB2_STATS_NETIF_ADD(netif, ifoutoctets, p->tot_len);
     if (((u8_t *)p->payload)[0] & 1) {
@@ -250,33 +456,42 @@ int ETHHW_ReadCallback(ETHHW_EventDesc *evt) {
     /* return indicator */
     int ret = 0;
 
-    /* move received packet into a new pbuf */
     struct pbuf *p, *q;
-    /* We allocate a pbuf chain of pbufs from the pool. */
-    p = pbuf_alloc(PBUF_RAW, evt->data.rx.size, PBUF_POOL);
-
-    if (p != NULL) {
-        /* save size waiting for being stored */
-        u16_t size_left = evt->data.rx.size;
-
-        /* We iterate over the pbuf chain until we have read the entire
-         * packet into the pbuf. */
-        for (q = p; (q != NULL) && (size_left > 0); q = q->next) {
-            /* Read enough bytes to fill this pbuf in the chain. The
-             * available data in the pbuf is given by the q->len
-             * variable.
-             * This does not necessarily have to be a memcpy, you can also preallocate
-             * pbufs for a DMA-enabled MAC and after receiving truncate it to the
-             * actually received size. In this case, ensure the tot_len member of the
-             * pbuf is the sum of the chained pbuf len members.
-             */
-
-            /* compute copy size and copy */
-            u16_t copy_size = MIN(size_left, q->len);
-            memcpy(q->payload, evt->data.rx.payload, copy_size);
-            size_left -= copy_size;
+    u16_t size = evt->data.rx.size;
+
+    /* wrap the DMA buffer into a custom pbuf if a spare buffer can replace it on the ring */
+    uint8_t *spare = ethdrv_take_rx_buf();
+    if (spare != NULL) {
+        EthRxPbuf *rp = ethdrv_get_rx_pbuf(evt->data.rx.payload);
+        p = pbuf_alloced_custom(PBUF_RAW, size, PBUF_REF, &rp->pc, rp->buf, ETH_RX_BUF_SIZE);
+        if (p != NULL) {
+            evt->data.rx.spare = spare;
+        } else {
+            ethdrv_give_rx_buf(spare);
+            spare = NULL;
         }
+    } else {
+        /* the pool is exhausted: move received packet into a new pbuf chain allocated from the pool */
+        p = pbuf_alloc(PBUF_RAW, size, PBUF_POOL);
+
+        if (p != NULL) {
+            /* save size waiting for being stored */
+            u16_t size_left = size;
+            const u8_t *src = (const u8_t *)evt->data.rx.payload;
+
+            /* We iterate over the pbuf chain until we have read the entire
+             * packet into the pbuf. */
+            for (q = p; (q != NULL) && (size_left > 0); q = q->next) {
+                /* compute copy size and copy, then advance in the source buffer */
+                u16_t copy_size = MIN(size_left, q->len);
+                memcpy(q->payload, src, copy_size);
+                src += copy_size;
+                size_left -= copy_size;
+            }
+        }
+    }
 
+    if (p != NULL) {
         /* Copy the timestamp into the first pbuf */
         p->time_s = evt->data.rx.ts_s;
         p->time_ns = evt->data.rx.ts_ns;
@@ -290,8 +505,8 @@ int ETHHW_ReadCallback(ETHHW_EventDesc *evt) {
             MIB2_STATS_NETIF_INC(netif, ifinucastpkts);
         }
 
-        /* packets has been processed and can be released */
-        ret = ETHHW_RET_RX_PROCESSED;
+        /* packets has been processed, the buffer can be released or has been taken over */
+        ret = (spare != NULL) ? ETHHW_RET_RX_LOANED : ETHHW_RET_RX_PROCESSED;
     } else {
         LINK_STATS_INC(link.memerr);
         LINK_STATS_INC(link.drop);
@@ -300,8 +515,9 @@ int ETHHW_ReadCallback(ETHHW_EventDesc *evt) {
 
     /* if no packet could be read, silently ignore this */
     if (p != NULL) {
-        /* pass all packets to ethernet_input, which decides what packets it supports */
-        if (if0->input(p, if0) != ERR_OK) {
+        /* pass all packets to ethernet_input, which decides what packets it supports;
+         * the poll already runs in the tcpip thread, posting them to its mailbox could only overflow it */
+        if (ethernet_input(p, if0) != ERR_OK) {
             LWIP_DEBUGF(NETIF_DEBUG, ("ethernetif_input: IP input error\n"));
             pbuf_free(p);
             p = NULL;
@@ -313,7 +529,10 @@ int ETHHW_ReadCallback(ETHHW_EventDesc *evt) {
 
 int ETHHW_EventCallback(ETHHW_EventDesc *evt) {
     if (evt->type == ETHHW_EVT_RX_NOTFY) {
-        ethernetif_input(if0);
+        ethernetif_input(if0); // RX interrupt is masked until the poll drains the ring
+    } else if (evt->type == ETHHW_EVT_TX_TS_READY) {
+        osThreadFlagsSet(txTsTh, ETH_TXTS_FLAG);
+        return 1;
     }
 
     return 0; // unhandled event
@@ -329,8 +548,30 @@ int ETHHW_EventCallback(ETHHW_EventDesc *evt) {
  * @param netif the lwip network interface structure for this ethernetif
  */
 static void ethernetif_input(struct netif *netif) {
+    /* defer reading received packets to the tcpip thread */
+    if (tcpip_callbackmsg_trycallback_fromisr(rxPollMsg) != ERR_OK) {
+        SET_BIT(ETH->DMACIER, ETHHW_RX_IRQ_MASK); /* mailbox is full, don't leave the RX interrupts masked */
+    }
+}
+
+/**
+ * Read at most ETH_RX_POLL_BUDGET received packets. Runs in the tcpip thread,
+ * packets are handed to ethernet_input() directly.
+ * If packets are still waiting, the poll is rescheduled behind the other
+ * pending messages, otherwise the RX interrupt has been re-enabled.
+ *
+ * @param arg the lwip network interface structure for this ethernetif
+ */
+static void ethernetif_poll(void *arg) {
+    /* release pbufs the DMA has finished with */
+    low_level_reclaim_tx();
+
     /* read received packets */
-    ETHHW_ProcessRx(ETH);
+    if (!ETHHW_PollRx(ETH, ETH_RX_POLL_BUDGET)) {
+        if (tcpip_callbackmsg_trycallback(rxPollMsg) != ERR_OK) {
+            SET_BIT(ETH->DMACIER, ETHHW_RX_IRQ_MASK); /* cannot reschedule, let the next interrupt do it */
+        }
+    }
 }
 
 /**
@@ -377,6 +618,12 @@ err_t ethernetif_init(struct netif *netif) {
     netif->output_ip6 = ethip6_output;
 #endif /* LWIP_IPV6 */
     netif->linkoutput = low_level_output;
+#if LWIP_IPV4 && LWIP_IGMP
+    netif_set_igmp_mac_filter(netif, ethernetif_igmp_mac_filter);
+#endif /* LWIP_IPV4 && LWIP_IGMP */
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+    netif_set_mld_mac_filter(netif, ethernetif_mld_mac_filter);
+#endif /* LWIP_IPV6 && LWIP_IPV6_MLD */
 
     /* initialize the hardware */
     low_level_init(netif);
@@ -102,8 +102,10 @@ static void ETHHW_InitPeripheral(ETH_TypeDef *eth, ETHHW_InitOpts *init) {
     memcpy(&hwaTmp, init->mac + 4, 2);
     WRITE_REG(eth->MACA0HR, hwaTmp);
 
-    // receive using perfect matching and multicast matching
-    SET_BIT(eth->MACPFR, ETH_MACPFR_PM | ETH_MACPFR_HPF);
+    // receive unicast using perfect matching and multicast using perfect or hash matching
+    WRITE_REG(eth->MACHT0R, 0);
+    WRITE_REG(eth->MACHT1R, 0);
+    SET_BIT(eth->MACPFR, ETH_MACPFR_HPF | ETH_MACPFR_HMC);
 
     // create a mode bit subfield based on the ETHHW_setup() return value
     uint32_t mode = 0;
@@ -156,7 +158,7 @@ static void ETHHW_InitPeripheral(ETH_TypeDef *eth, ETHHW_InitOpts *init) {
     uint8_t *txBuf = init->bufPtr + alignedBufSize * init->rxRingLen; // fill in later used buffer addresses
     for (uint16_t i = 0; i < init->txRingLen; i++) {
         ETHHW_DescFull *bd = ring + i;
-        bd->ext.bufAddr = ((uint32_t)txBuf) + i * alignedBufSize;
+        bd->ext.bufAddr = init->noTxBufs ? 0 : (((uint32_t)txBuf) + i * alignedBufSize);
     }
 
     // write transmit-related registers
@@ -174,23 +176,66 @@ static ETHHW_State *ETHHW_GetState(ETH_TypeDef *eth) {
     return ((ETHHW_State *)eth->DMACRDLAR) - 1;
 }
 
-static void ETHHW_InitState(ETH_TypeDef *eth) {
+static void ETHHW_InitState(ETH_TypeDef *eth, ETHHW_InitOpts *init) {
     ETHHW_State *state = ETHHW_GetState(eth);
     state->nextTxDescIdx = 0;
     state->txCntSent = 0;
     state->txCntAcked = 0;
+    state->txQueue = init->txQueuePtr;
+    state->txQueueLen = (init->txQueuePtr != NULL) ? init->txQueueLen : 0;
+    state->txQueueHead = 0;
+    state->txQueueCnt = 0;
+    state->txDoneIdx = 0;
+    state->txPending = 0;
+    state->rxHeadIdx = 0;
+    state->txIocCnt = 0;
+    memset(&state->irqMod, 0, sizeof(ETHHW_IrqModeration));
+    memset(&state->txStats, 0, sizeof(ETHHW_TxStats));
+    state->txTsWr = 0;
+    state->txTsRd = 0;
+    state->txTsInIsr = true;
+    memset(&state->isrStats, 0, sizeof(ETHHW_IsrStats));
+    state->recoverPending = false;
+    memset(&state->errStats, 0, sizeof(ETHHW_ErrStats));
+    memset(&state->mcFilter, 0, sizeof(ETHHW_McastFilter));
+    memset(state->l3l4Rules, 0, sizeof(state->l3l4Rules));
+    memset(state->l3l4Hits, 0, sizeof(state->l3l4Hits));
+    state->ptpSnapMode = ETHHW_PTP_SNAP_ALL_MSGS;
+    state->ptpTransports = ETHHW_PTP_TRANSPORT_L2 | ETHHW_PTP_TRANSPORT_UDP_IPV4;
+    memset(&state->rxTsStats, 0, sizeof(ETHHW_RxTsStats));
+
+    // start the cycle counter for the interrupt duration measurement
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 }
 
+// PTP multicast addresses: L2 general, L2 peer delay, IPv4 (224.0.1.129, 224.0.0.107) and IPv6 (FF0E::181, FF02::6B)
+static const uint8_t ETHHW_PTP_MCAST_ADDRS[][6] = {
+    {0x01, 0x1B, 0x19, 0x00, 0x00, 0x00},
+    {0x01, 0x80, 0xC2, 0x00, 0x00, 0x0E},
+    {0x01, 0x00, 0x5E, 0x00, 0x01, 0x81},
+    {0x01, 0x00, 0x5E, 0x00, 0x00, 0x6B},
+    {0x33, 0x33, 0x00, 0x00, 0x01, 0x81},
+    {0x33, 0x33, 0x00, 0x00, 0x00, 0x6B}};
+
 void ETHHW_Init(ETH_TypeDef *eth, ETHHW_InitOpts *init) {
     ETHHW_InitClocks();
     ETHHW_InitPeripheral(eth, init);
-    ETHHW_InitState(eth);
+    ETHHW_InitState(eth, init);
+
+    // let PTP messages in
+    for (uint8_t i = 0; i < (sizeof(ETHHW_PTP_MCAST_ADDRS) / 6); i++) {
+        ETHHW_AddMulticastFilter(eth, ETHHW_PTP_MCAST_ADDRS[i]);
+    }
 }
 
 void ETHHW_Start(ETH_TypeDef *eth) {
     SET_BIT(eth->DMACIER, ETH_DMACIER_NIE); // normal interrupt enable
     SET_BIT(eth->DMACIER, ETH_DMACIER_RIE); // receive interrupt enable
     SET_BIT(eth->DMACIER, ETH_DMACIER_TIE); // transmit interrupt enable
+    SET_BIT(eth->DMACIER, ETH_DMACIER_AIE | ETH_DMACIER_RBUE | ETH_DMACIER_RSE | ETH_DMACIER_TXSE | ETH_DMACIER_FBEE | ETH_DMACIER_CDEE); // abnormal interrupts
+    SET_BIT(eth->MTLQICSR, ETH_MTLQICSR_TXUIE | ETH_MTLQICSR_RXOIE);                                                                  // MTL queue underflow and overflow interrupts
+    WRITE_REG(eth->DMACRIWTR, 1);           // shortest RX watchdog, IOC is set on the descriptors until moderation is turned on
 
     // start DMA reception and transmission
     SET_BIT(eth->DMACRCR, ETH_DMACRCR_SR);
@@ -225,9 +270,9 @@ ETHHW_DescFull *ETHHW_AdvanceDesc(ETHHW_DescFull *start, uint16_t n, ETHHW_DescF
 #define ETHHW_DESC_PREV(s, n, p) ETHHW_AdvanceDesc((s), (n), (p), -1)
 #define ETHHW_DESC_NEXT(s, n, p) ETHHW_AdvanceDesc((s), (n), (p), 1)
 
-static void ETHHW_RestoreRXDesc(ETHHW_DescFull *bd) {
-    bd->desc.DES0 = bd->ext.bufAddr;                                                          // store Buffer 1 address
-    bd->desc.DES3 = 0 | ETH_DMARXNDESCRF_OWN | ETH_DMARXNDESCRF_IOC | ETH_DMARXNDESCRF_BUF1V; // set flags: OWN, IOC, BUF1V
+static void ETHHW_RestoreRXDesc(ETHHW_DescFull *bd, bool ioc) {
+    bd->desc.DES0 = bd->ext.bufAddr;                                                                          // store Buffer 1 address
+    bd->desc.DES3 = 0 | ETH_DMARXNDESCRF_OWN | (ioc ? ETH_DMARXNDESCRF_IOC : 0) | ETH_DMARXNDESCRF_BUF1V; // set flags: OWN, IOC (unless moderated), BUF1V
 }
 
 typedef enum { ETHHW_RINGBUF_RX,
@@ -331,25 +376,31 @@ static void ETHHW_PrintRingBufStatus(ETH_TypeDef *eth,
 #define ETHHW_DESC_OWNED_BY_APPLICATION(bd) \
     (!(((bd)->desc.DES3) & ETH_DMARXNDESCRF_OWN))
 
-// process incoming packet
-void ETHHW_ProcessRx(ETH_TypeDef *eth) {
+static void ETHHW_RecoverDma(ETH_TypeDef *eth);
+
+bool ETHHW_PollRx(ETH_TypeDef *eth, uint16_t budget) {
     // ETHHW_PrintRingBufStatus(eth, ETHHW_RINGBUF_RX);
 
+    ETHHW_State *state = ETHHW_GetState(eth);
+
+    // the DMA has stopped on an error, restart it with fresh rings
+    if (state->recoverPending) {
+        ETHHW_RecoverDma(eth);
+    }
+
     ETHHW_DescFull *ring = (ETHHW_DescFull *)eth->DMACRDLAR;
     uint16_t ringLen = eth->DMACRDRLR + 1;
+    uint16_t processed = 0;
 
-    // get current descriptor
-    ETHHW_DescFull *bd = (ETHHW_DescFull *)eth->DMACCARDR;
-    ETHHW_DescFull *bd_prev = ETHHW_DESC_PREV(ring, ringLen, bd);
-
-    // get the first unprocessed descriptor (oldest one)
-    while (ETHHW_DESC_OWNED_BY_APPLICATION(bd_prev)) {
-        bd = bd_prev;
-        bd_prev = ETHHW_DESC_PREV(ring, ringLen, bd);
-    }
+    // start at the oldest unprocessed descriptor
+    ETHHW_DescFull *bd = ring + state->rxHeadIdx;
 
     // iterate over unprocessed descriptors
     while (ETHHW_DESC_OWNED_BY_APPLICATION(bd)) {
+        if (processed >= budget) {
+            return false; // budget exhausted, RX interrupt remains masked
+        }
+
         ETHHW_DescFull *bd_next = ETHHW_DESC_NEXT(ring, ringLen, bd);
 
         ETHHW_EventDesc evt;
@@ -361,8 +412,12 @@ void ETHHW_ProcessRx(ETH_TypeDef *eth) {
         bool tsFound = bd->desc.DES1 & ETH_DMARXNDESCWBF_TSA;
         ETHHW_DescFull *ctx_bd = NULL; // context descriptor holding the timestamp
         if (tsFound) {
-            // fetch timestamp
             ctx_bd = bd_next;
+            if (!ETHHW_DESC_OWNED_BY_APPLICATION(ctx_bd)) {
+                return false; // the context descriptor is not written back yet, come back later
+            }
+
+            // fetch timestamp
             evt.data.rx.ts_s = ctx_bd->desc.DES1;
             evt.data.rx.ts_ns = ctx_bd->desc.DES0;
 
@@ -370,156 +425,634 @@ void ETHHW_ProcessRx(ETH_TypeDef *eth) {
             bd_next = ETHHW_DESC_NEXT(ring, ringLen, bd_next);
         }
 
+        evt.data.rx.spare = NULL;
+
         int ret = ETHHW_ReadCallback(&evt);
-        if (ret == ETHHW_RET_RX_PROCESSED) {
-            ETHHW_RestoreRXDesc(bd);     // release buffer descriptor
-            ETHHW_RestoreRXDesc(ctx_bd); // and context descriptor also
+        if (ret == ETHHW_RET_RX_LOANED) {
+            bd->ext.bufAddr = (uint32_t)evt.data.rx.spare; // swap in the replacement buffer
+        }
+
+        // count frames and consumed context descriptors
+        state->rxTsStats.frames++;
+        state->rxTsStats.timestamped += tsFound ? 1 : 0;
+
+        // count L3/L4 filter hits
+        uint32_t DES2 = bd->desc.DES2;
+        if (DES2 & (ETH_DMARXNDESCWBF_L3FM | ETH_DMARXNDESCWBF_L4FM)) {
+            state->l3l4Hits[(DES2 & ETH_DMARXNDESCWBF_L3L4FM) ? 1 : 0]++;
+        }
+
+        // measure the delay between reception and processing
+        if (tsFound) {
+            uint32_t now_s, now_ns;
+            do { // reread if the seconds have changed in the meantime
+                now_s = eth->MACSTSR;
+                now_ns = eth->MACSTNR;
+            } while (now_s != eth->MACSTSR);
+            if ((now_s - evt.data.rx.ts_s) < 4) { // skip frames received before a time step
+                uint32_t lat = (now_s - evt.data.rx.ts_s) * 1000000000 + now_ns - evt.data.rx.ts_ns;
+                state->isrStats.rxLatLastNs = lat;
+                if (lat > state->isrStats.rxLatMaxNs) {
+                    state->isrStats.rxLatMaxNs = lat;
+                }
+            }
         }
 
+        // release buffer descriptor and context descriptor also (the packet is dropped if it could not be processed)
+        bool ioc = state->irqMod.rxWatchdogUs == 0;
+        ETHHW_RestoreRXDesc(bd, ioc);
+        if (ctx_bd != NULL) {
+            ETHHW_RestoreRXDesc(ctx_bd, ioc);
+        }
+        WRITE_REG(eth->DMACRDTPR, 0); // resume the DMA if it has suspended for the lack of descriptors
+
         bd = bd_next;
+        state->rxHeadIdx = bd - ring;
+        processed++;
     }
 
-    // ETHHW_print_rx_ringbuf_status(eth, ETHHW_RINGBUF_RX);
+    // an error has occurred during the poll, come back to recover
+    if (state->recoverPending) {
+        return false;
+    }
 
-    // (*(bd-1)).desc.DES3
-    // MSG("TAIL: %p SIZE: %u\n", bd, size);
+    // ring is drained, re-enable the RX interrupts (fire right away if a packet has arrived in the meantime)
+    SET_BIT(eth->DMACIER, ETHHW_RX_IRQ_MASK);
+    return true;
 }
 
-void ETHHW_ProcessTx(ETH_TypeDef *eth) {
-    //    ETHHW_PrintRingBufStatus(eth, ETHHW_RINGBUF_TX);
+// process incoming packet
+void ETHHW_ProcessRx(ETH_TypeDef *eth) {
+    ETHHW_PollRx(eth, UINT16_MAX);
+}
 
-    uint16_t ringLen = eth->DMACTDRLR + 1;
+// invoke a TX timestamp callback
+static void ETHHW_InvokeTxTsCb(const ETHHW_TxTsRecord *rec) {
+    ((void (*)(uint32_t, uint32_t, uint32_t))(rec->tsCbPtr))(rec->ts_s, rec->ts_ns, rec->tsCbArg);
+}
 
-    ETHHW_State *state = ETHHW_GetState(ETH);
-    uint16_t minIdx = 0;
-    int32_t minDelta = 0;
-    ETHHW_DescFull *ring = (ETHHW_DescFull *)eth->DMACTDLAR;
+// report a TX timestamp (interrupt context), returns true if it has been put into the completion ring
+static bool ETHHW_ReportTxTs(ETHHW_State *state, const ETHHW_TxTsRecord *rec) {
+    if (!state->txTsInIsr) {
+        uint16_t wr = state->txTsWr;
+        uint16_t rd = __atomic_load_n(&state->txTsRd, __ATOMIC_ACQUIRE);
+        if ((uint16_t)(wr - rd) < ETHHW_TX_TS_RING_LEN) {
+            state->txTsRing[wr % ETHHW_TX_TS_RING_LEN] = *rec;
+            __atomic_store_n(&state->txTsWr, wr + 1, __ATOMIC_RELEASE); // record MUST be complete before publishing
+            state->isrStats.tsDeferred++;
+            return true;
+        }
+        state->isrStats.tsRingFull++; // the dispatcher is lagging, do not lose the timestamp
+    }
 
-    uint16_t descsWithTimestamp = 0;
-
-    do {
-        // search for oldest timestamp-carrying descriptor
-        bool firstIteration = true;
-        for (uint16_t i = 0; i < ringLen; i++) {
-            uint16_t txCntr = ring[i].ext.txCntr;
-            uint32_t DES3 = ring[i].desc.DES3;
-            if ((DES3 & ETH_DMATXNDESCWBF_TTSS) && !(DES3 & ETH_DMATXNDESCWBF_OWN)) { // examine only descriptors holding a timestamp
-                descsWithTimestamp++;                                                 // desc found with timestamp
-                int32_t delta = (int32_t)txCntr - (int32_t)state->txCntAcked;
-
-                if (firstIteration) { // initialize variables with valid data
-                    firstIteration = false;
-                    minDelta = delta;
-                    minIdx = i;
-                    continue;
-                }
+    ETHHW_InvokeTxTsCb(rec);
+    state->isrStats.tsInIsr++;
+    return false;
+}
 
-                if (delta == 1) { // consecutive packets found, stop search
-                    minIdx = i;
-                    minDelta = 1;
-                } else { // search for minimum "distance"
-                    if (delta < minDelta) {
-                        minIdx = i;
-                        minDelta = delta;
-                    }
-                }
-            }
+// Walk the completed TX descriptors in order from the completion cursor. Descriptors complete in order,
+// so each one is visited exactly once. Timestamps are reported only if reportTs is set (interrupt context),
+// otherwise the walk stops at a descriptor waiting for its timestamp to be reported.
+static void ETHHW_CompleteTx(ETH_TypeDef *eth, bool reportTs) {
+    ETHHW_State *state = ETHHW_GetState(eth);
+    uint16_t ringLen = eth->DMACTDRLR + 1;
+    ETHHW_DescFull *ring = (ETHHW_DescFull *)eth->DMACTDLAR;
+    bool deferred = false;
+
+    while (state->txPending > 0) {
+        ETHHW_DescFull *bd = ring + state->txDoneIdx;
+        uint32_t DES3 = bd->desc.DES3;
+        if (DES3 & ETH_DMATXNDESCWBF_OWN) { // not transmitted yet, neither are the following ones
+            break;
         }
 
-        if (descsWithTimestamp > 0) {
-            // invoke callback (the descriptor certainly contains a valid callback
-            // address, see transmit function why)
-            ETHHW_DescFull *bd = ring + minIdx;
-            uint32_t ts_s = bd->desc.DES1;
-            uint32_t ts_ns = bd->desc.DES0;
+        if (bd->ext.tsCbPtr != 0) {
+            if (!reportTs) {
+                break;
+            }
 
-            if (bd->ext.tsCbPtr != 0) {
-                ((void (*)(uint32_t, uint32_t, uint32_t))(bd->ext.tsCbPtr))(ts_s, ts_ns, bd->ext.tsCbArg);
+            // report the timestamp if it has been captured
+            if (DES3 & ETH_DMATXNDESCWBF_TTSS) {
+                ETHHW_TxTsRecord rec = {bd->ext.tsCbPtr, bd->ext.tsCbArg, bd->desc.DES1, bd->desc.DES0};
+                deferred |= ETHHW_ReportTxTs(state, &rec);
             }
 
             // clear descriptor
             memset((void *)bd, 0, sizeof(ETHHW_Desc));
             bd->ext.tsCbPtr = 0;
             bd->ext.tsCbArg = 0;
+        }
 
-            // increment TX acknowledge counter
-            state->txCntAcked = bd->ext.txCntr;
+        // increment TX acknowledge counter
+        state->txCntAcked = bd->ext.txCntr;
 
-            // decrement number of remaining unprocessed descriptors carrying a
-            // timestamp
-            descsWithTimestamp--;
-        }
+        // advance the cursor
+        state->txDoneIdx = (state->txDoneIdx + 1) % ringLen;
+        state->txPending--;
+    }
+
+    // wake up the dispatcher
+    if (deferred) {
+        ETHHW_EventDesc evt;
+        evt.type = ETHHW_EVT_TX_TS_READY;
+        ETHHW_EventCallback(&evt);
+    }
+}
+
+void ETHHW_DispatchTxTimestamps(ETH_TypeDef *eth) {
+    ETHHW_State *state = ETHHW_GetState(eth);
+    uint16_t rd = state->txTsRd;
+    while (rd != __atomic_load_n(&state->txTsWr, __ATOMIC_ACQUIRE)) {
+        ETHHW_TxTsRecord rec = state->txTsRing[rd % ETHHW_TX_TS_RING_LEN];
+        rd++;
+        __atomic_store_n(&state->txTsRd, rd, __ATOMIC_RELEASE); // slot can be reused
+        ETHHW_InvokeTxTsCb(&rec);
+    }
+}
+
+void ETHHW_SetTxTsInIsr(ETH_TypeDef *eth, bool inIsr) {
+    ETHHW_GetState(eth)->txTsInIsr = inIsr;
+}
 
-    } while (descsWithTimestamp > 0);
+bool ETHHW_GetTxTsInIsr(ETH_TypeDef *eth) {
+    return ETHHW_GetState(eth)->txTsInIsr;
+}
+
+const ETHHW_IsrStats *ETHHW_GetIsrStats(ETH_TypeDef *eth) {
+    return &ETHHW_GetState(eth)->isrStats;
+}
+
+void ETHHW_ClearIsrStats(ETH_TypeDef *eth) {
+    memset(&ETHHW_GetState(eth)->isrStats, 0, sizeof(ETHHW_IsrStats));
+}
+
+void ETHHW_SetIrqModeration(ETH_TypeDef *eth, const ETHHW_IrqModeration *mod) {
+    ETHHW_State *state = ETHHW_GetState(eth);
+
+    // the watchdog counts in units of 256 bus clock cycles, a nonzero count is kept even without moderation
+    // so that descriptors re-armed without IOC before turning it off are still signalled
+    uint32_t rwt = 1;
+    if (mod->rxWatchdogUs > 0) {
+        uint32_t cyclesPerUs = HAL_RCC_GetHCLKFreq() / 1000000;
+        rwt = (mod->rxWatchdogUs * cyclesPerUs + 255) / 256;
+        rwt = (rwt > 0xFF) ? 0xFF : rwt;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    state->irqMod = *mod;
+    state->txIocCnt = 0;
+    WRITE_REG(eth->DMACRIWTR, rwt << ETH_DMACRIWTR_RWT_Pos);
+    __set_PRIMASK(primask);
+}
+
+const ETHHW_IrqModeration *ETHHW_GetIrqModeration(ETH_TypeDef *eth) {
+    return &ETHHW_GetState(eth)->irqMod;
+}
+
+static void ETHHW_DrainTxQueue(ETH_TypeDef *eth);
+
+void ETHHW_ProcessTx(ETH_TypeDef *eth) {
+    //    ETHHW_PrintRingBufStatus(eth, ETHHW_RINGBUF_TX);
+
+    // report timestamps of the completed descriptors
+    ETHHW_CompleteTx(eth, true);
+
+    // push packets waiting in the overflow queue into the released descriptors
+    ETHHW_DrainTxQueue(eth);
+}
+
+// handle abnormal DMA interrupts, called from the interrupt
+static void ETHHW_ProcessAbnormal(ETH_TypeDef *eth, uint32_t csr) {
+    ETHHW_State *state = ETHHW_GetState(eth);
+    ETHHW_ErrStats *stats = &state->errStats;
+    bool rxPoll = false;
+    bool rxIrqEn = READ_BIT(eth->DMACIER, ETH_DMACIER_RIE); // no poll is in progress
+
+    // RX ring ran out of descriptors, the DMA has suspended; only a stall if no poll is draining the ring
+    // (the status is still raised while RBUE is masked)
+    if ((csr & ETH_DMACSR_RBU) && rxIrqEn) {
+        stats->rxBufUnavail++;
+        rxPoll = true; // the poll re-arms the descriptors and kicks the tail pointer
+    }
+    if (csr & ETH_DMACSR_CDE) {
+        stats->ctxDescErr++;
+    }
+
+    // stopping is only abnormal if no stop has been requested, the DMA stops on its own only on a fatal bus error
+    if ((csr & ETH_DMACSR_RPS) && READ_BIT(eth->DMACRCR, ETH_DMACRCR_SR)) {
+        stats->rxStopped++;
+    }
+    if ((csr & ETH_DMACSR_TPS) && READ_BIT(eth->DMACTCR, ETH_DMACTCR_ST)) {
+        stats->txStopped++;
+    }
+    if (csr & ETH_DMACSR_FBE) { // both DMA engines have stopped
+        stats->fatalBusErr++;
+        state->recoverPending = true;
+    }
+
+    WRITE_REG(eth->DMACSR, csr & (ETH_DMACSR_RBU | ETH_DMACSR_CDE | ETH_DMACSR_RPS | ETH_DMACSR_TPS | ETH_DMACSR_FBE | ETH_DMACSR_AIS)); // write 1 to clear
+
+    // schedule a poll unless one is in progress (RX interrupts masked)
+    if ((rxPoll || state->recoverPending) && rxIrqEn) {
+        CLEAR_BIT(eth->DMACIER, ETHHW_RX_IRQ_MASK);
+
+        ETHHW_EventDesc evt;
+        evt.type = ETHHW_EVT_RX_NOTFY;
+        ETHHW_EventCallback(&evt);
+    }
 }
 
 void ETHHW_ISR(ETH_TypeDef *eth) {
+    uint32_t start = DWT->CYCCNT;
     uint32_t csr = READ_REG(eth->DMACSR);
 
     // MSG("ETH [0x%X]\n", csr);
 
+    // acknowledge the normal events of the snapshot only (write 1 to clear), events raised meanwhile must stay pending
+    WRITE_REG(eth->DMACSR, csr & (ETH_DMACSR_RI | ETH_DMACSR_TI | ETH_DMACSR_NIS));
+
     if (csr & ETH_DMACSR_NIS) {    // Normal Interrupt Summary
         if (csr & ETH_DMACSR_RI) { // Receive Interrupt
-            SET_BIT(ETH->DMACSR, ETH_DMACSR_RI);
-            SET_BIT(ETH->DMACSR, ETH_DMACSR_NIS);
+            CLEAR_BIT(eth->DMACIER, ETHHW_RX_IRQ_MASK); // mask RX interrupts (also running out of descriptors) until the poll drains the ring
+            ETHHW_GetState(eth)->isrStats.rxIrqCnt++;
 
             ETHHW_EventDesc evt;
             evt.type = ETHHW_EVT_RX_NOTFY;
             ETHHW_EventCallback(&evt);
-        } else if (csr & ETH_DMACSR_TI) { // Transmit Interrupt
-            SET_BIT(ETH->DMACSR, ETH_DMACSR_TI);
+        }
+        if (csr & ETH_DMACSR_TI) { // Transmit Interrupt
+            ETHHW_GetState(eth)->isrStats.txIrqCnt++;
 
             ETHHW_ProcessTx(eth);
         }
     }
 
-    SET_BIT(ETH->DMACSR, ETH_DMACSR_NIS);
+    if (csr & ETH_DMACSR_AIS) { // Abnormal Interrupt Summary
+        ETHHW_ProcessAbnormal(eth, csr);
+    }
+
+    // MTL queue interrupts
+    if (eth->MTLISR & ETH_MTLISR_QIS) {
+        ETHHW_ErrStats *errStats = &ETHHW_GetState(eth)->errStats;
+        uint32_t qcsr = READ_REG(eth->MTLQICSR);
+        if (qcsr & ETH_MTLQICSR_TXUNFIS) {
+            errStats->txUnderflow++;
+        }
+        if (qcsr & ETH_MTLQICSR_RXOVFIS) {
+            errStats->rxOverflow++;
+        }
+        WRITE_REG(eth->MTLQICSR, qcsr); // clear status bits, keep the enables
+    }
+
+    // measure interrupt duration
+    ETHHW_IsrStats *stats = &ETHHW_GetState(eth)->isrStats;
+    uint32_t cycles = DWT->CYCCNT - start;
+    stats->isrCnt++;
+    stats->isrLastCycles = cycles;
+    if (cycles > stats->isrMaxCycles) {
+        stats->isrMaxCycles = cycles;
+    }
 }
 
-void ETHHW_Transmit(ETH_TypeDef *eth, const uint8_t *buf, uint16_t len, uint8_t txOpts, void *txOptArgs) {
-    ETHHW_State *state = ETHHW_GetState(eth);                                // fetch state
-    uint16_t nextTxDescIdx = state->nextTxDescIdx;                           // fetch index of descriptor to fill
-    ETHHW_DescFull *bd = ((ETHHW_DescFull *)eth->DMACTDLAR) + nextTxDescIdx; // get descriptor being filled
+// hand back the zero-copy buffer of a released TX descriptor, called with interrupts disabled
+static void ETHHW_ReleaseTxBuf(ETHHW_DescFull *bd) {
+    if (bd->ext.txBuf != 0) {
+        ETHHW_EventDesc evt;
+        evt.type = ETHHW_EVT_TX_RELEASE;
+        evt.data.txRelease.buf = (void *)bd->ext.txBuf;
+        bd->ext.txBuf = 0;
+        ETHHW_EventCallback(&evt);
+    }
+}
 
-    // MSG("%u\n", nextTxDesc);
+// decide if a frame requests a TX completion interrupt, every Nth frame does so to release buffers in time; called with interrupts disabled
+static bool ETHHW_TxIocRequired(ETHHW_State *state, bool requested) {
+    uint16_t every = state->irqMod.txIocEvery;
+    if ((every > 0) && ((state->txIocCnt + 1) >= every)) {
+        requested = true;
+    }
+    state->txIocCnt = requested ? 0 : (state->txIocCnt + 1);
+    return requested;
+}
 
-    // ETHHW_PrintRingBufStatus(eth, ETHHW_RINGBUF_TX);
+// fill the next TX descriptor (MUST be released by the DMA) and pass it to the DMA, called with interrupts disabled
+static void ETHHW_FillTxDesc(ETH_TypeDef *eth, const uint8_t *buf, uint16_t len, uint8_t txOpts, uint32_t tsCbPtr, uint32_t tsCbArg) {
+    ETHHW_State *state = ETHHW_GetState(eth);                      // fetch state
+    uint16_t ringLen = eth->DMACTDRLR + 1;                         // TX ring length
+    ETHHW_DescFull *ring = (ETHHW_DescFull *)eth->DMACTDLAR;       // TX ring
+    ETHHW_DescFull *bd = ring + state->nextTxDescIdx;              // get descriptor being filled
+    uint16_t nextTxDescIdx = (state->nextTxDescIdx + 1) % ringLen; // index of the following descriptor
+    state->txPending++;
 
-    while (!ETHHW_DESC_OWNED_BY_APPLICATION(bd)) {
-    } // wait for descriptor to become released by the DMA (if needed)
+    // the previous zero-copy buffer of the descriptor is surely done
+    ETHHW_ReleaseTxBuf(bd);
 
     // erase possible old descriptor data
     memset(bd, 0, sizeof(ETHHW_Desc)); // DON'T erase extension
 
+    // this packet fills the ring: its completion must drain the overflow queue
+    bool ioc = (txOpts & ETHHW_TXOPT_INTERRUPT_ON_COMPLETION) || ((state->txQueue != NULL) && (state->txPending == ringLen));
+
     uint32_t opts = 0;
-    if (txOpts & ETHHW_TXOPT_INTERRUPT_ON_COMPLETION) {
+    if (ETHHW_TxIocRequired(state, ioc)) {
         opts |= ETH_DMATXNDESCRF_IOC;
     }
 
-    if ((txOpts == ETHHW_TXOPT_CAPTURE_TS) &&
-        (txOptArgs != NULL)) { // arguments are mandatory
+    if (tsCbPtr != 0) {
         opts |= ETH_DMATXNDESCRF_TTSE;
-        ETHHW_OptArg_TxTsCap *arg = (ETHHW_OptArg_TxTsCap *)txOptArgs; // retrieve args
-        bd->ext.tsCbPtr = arg->txTsCbPtr;                              // fill-in extension fields
-        bd->ext.tsCbArg = arg->tag;
     }
+    bd->ext.tsCbPtr = tsCbPtr; // fill-in extension fields
+    bd->ext.tsCbArg = tsCbArg;
 
     // fill-in identification field
     bd->ext.txCntr = ++state->txCntSent; // copy AFTER increase
 
-    // copy payload to TX buffer
-    memcpy((void *)bd->ext.bufAddr, buf, len);
+    if (txOpts & ETHHW_TXOPT_ZERO_COPY) {
+        // let the DMA read the caller's buffer, keep it until released
+        bd->ext.txBuf = (uint32_t)buf;
+        bd->desc.DES0 = (uint32_t)buf;
+    } else {
+        // copy payload to TX buffer
+        memcpy((void *)bd->ext.bufAddr, buf, len);
+        bd->desc.DES0 = bd->ext.bufAddr;
+    }
 
     // fill in-descriptor fields
-    bd->desc.DES0 = bd->ext.bufAddr;
     bd->desc.DES2 = opts | (len & 0x3FFF);                                                                                                  // {IOC|TTSE} and buffer length truncated to 14-bits
     bd->desc.DES3 = ETH_DMATXNDESCRF_OWN | ETH_DMATXNDESCRF_FD | ETH_DMATXNDESCRF_LD | ETH_DMATXNDESCRF_CIC_IPHDR_PAYLOAD_INSERT_PHDR_CALC; // pass desciptor to the DMA, set First Desc. and Last Desc. flags
 
     //ETHHW_PrintRingBufStatus(eth, ETHHW_RINGBUF_TX);
 
-    state->nextTxDescIdx = (state->nextTxDescIdx + 1) % (eth->DMACTDRLR + 1); // advance index to next descriptor
+    state->nextTxDescIdx = nextTxDescIdx; // advance index to next descriptor
+
+    WRITE_REG(eth->DMACTDTPR, 0); // tail pointer WON'T STOP
+}
+
+// move queued packets into released descriptors, called from the TX-complete interrupt or with interrupts disabled
+static void ETHHW_DrainTxQueue(ETH_TypeDef *eth) {
+    ETHHW_State *state = ETHHW_GetState(eth);
+    uint16_t ringLen = eth->DMACTDRLR + 1;
+
+    while ((state->txQueueCnt > 0) && (state->txPending < ringLen)) {
+        ETHHW_TxQueueItem *item = state->txQueue + state->txQueueHead;
+        ETHHW_FillTxDesc(eth, item->buf, item->len, item->txOpts, item->tsCbPtr, item->tsCbArg);
+        state->txQueueHead = (state->txQueueHead + 1) % state->txQueueLen;
+        state->txQueueCnt--;
+    }
+}
+
+void ETHHW_ReleaseTx(ETH_TypeDef *eth) {
+    uint16_t ringLen = eth->DMACTDRLR + 1;
+    ETHHW_DescFull *ring = (ETHHW_DescFull *)eth->DMACTDLAR;
+
+    // the interrupt refills descriptors, check and clear them in one go
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (uint16_t i = 0; i < ringLen; i++) {
+        ETHHW_DescFull *bd = ring + i;
+        if ((bd->ext.txBuf != 0) && ETHHW_DESC_OWNED_BY_APPLICATION(bd)) {
+            ETHHW_ReleaseTxBuf(bd);
+        }
+    }
+
+    // the interrupt might have missed released descriptors
+    ETHHW_CompleteTx(eth, false);
+    ETHHW_DrainTxQueue(eth);
+    __set_PRIMASK(primask);
+}
+
+// reinitialize both rings and restart the DMA after it has stopped on an error, called from the RX poll
+static void ETHHW_RecoverDma(ETH_TypeDef *eth) {
+    ETHHW_State *state = ETHHW_GetState(eth);
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    // make sure both DMA engines remain stopped
+    CLEAR_BIT(eth->DMACRCR, ETH_DMACRCR_SR);
+    CLEAR_BIT(eth->DMACTCR, ETH_DMACTCR_ST);
+
+    // re-arm every RX descriptor, frames not yet processed are lost
+    ETHHW_DescFull *ring = (ETHHW_DescFull *)eth->DMACRDLAR;
+    uint16_t ringLen = eth->DMACRDRLR + 1;
+    bool ioc = state->irqMod.rxWatchdogUs == 0;
+    for (uint16_t i = 0; i < ringLen; i++) {
+        ring[i].desc.DES1 = 0;
+        ring[i].desc.DES2 = 0;
+        ETHHW_RestoreRXDesc(ring + i, ioc);
+    }
+    state->rxHeadIdx = 0;
+    WRITE_REG(eth->DMACRDLAR, (uint32_t)ring); // rewind the DMA to the ring start
+
+    // drop the frames in flight, hand back their buffers
+    SET_BIT(eth->MTLTQOMR, ETH_MTLTQOMR_FTQ);
+    for (uint32_t i = 0; (i < 100000) && READ_BIT(eth->MTLTQOMR, ETH_MTLTQOMR_FTQ); i++) {
+    }
+
+    ring = (ETHHW_DescFull *)eth->DMACTDLAR;
+    ringLen = eth->DMACTDRLR + 1;
+    for (uint16_t i = 0; i < ringLen; i++) {
+        ETHHW_DescFull *bd = ring + i;
+        ETHHW_ReleaseTxBuf(bd);
+        memset(bd, 0, sizeof(ETHHW_Desc)); // DON'T erase extension
+        bd->ext.tsCbPtr = 0;
+        bd->ext.tsCbArg = 0;
+    }
+    state->nextTxDescIdx = 0;
+    state->txDoneIdx = 0;
+    state->txPending = 0;
+    state->txCntAcked = state->txCntSent;
+    WRITE_REG(eth->DMACTDLAR, (uint32_t)ring);
+
+    // clear the error and restart
+    WRITE_REG(eth->DMACSR, ETH_DMACSR_FBE | ETH_DMACSR_RPS | ETH_DMACSR_TPS | ETH_DMACSR_RBU | ETH_DMACSR_AIS);
+    state->recoverPending = false;
+    state->errStats.recoveries++;
+    SET_BIT(eth->DMACRCR, ETH_DMACRCR_SR);
+    SET_BIT(eth->DMACTCR, ETH_DMACTCR_ST);
+    WRITE_REG(eth->DMACRDTPR, 0);
+
+    // send the packets waiting in the overflow queue
+    ETHHW_DrainTxQueue(eth);
+
+    __set_PRIMASK(primask);
+}
+
+const ETHHW_ErrStats *ETHHW_GetErrStats(ETH_TypeDef *eth) {
+    return &ETHHW_GetState(eth)->errStats;
+}
+
+ETHHW_TxStatus ETHHW_Transmit(ETH_TypeDef *eth, const uint8_t *buf, uint16_t len, uint8_t txOpts, void *txOptArgs) {
+    ETHHW_State *state = ETHHW_GetState(eth); // fetch state
+
+    // copying needs a bounce buffer
+    if (!(txOpts & ETHHW_TXOPT_ZERO_COPY) && (((ETHHW_DescFull *)eth->DMACTDLAR)->ext.bufAddr == 0)) {
+        return ETHHW_TX_ERROR;
+    }
+
+    uint32_t tsCbPtr = 0, tsCbArg = 0;
+    if (((txOpts & ETHHW_TXOPT_CAPTURE_TS) == ETHHW_TXOPT_CAPTURE_TS) &&
+        (txOptArgs != NULL)) {                                         // arguments are mandatory
+        ETHHW_OptArg_TxTsCap *arg = (ETHHW_OptArg_TxTsCap *)txOptArgs; // retrieve args
+        tsCbPtr = arg->txTsCbPtr;
+        tsCbArg = arg->tag;
+    }
+
+    ETHHW_TxStatus ret;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    ETHHW_CompleteTx(eth, false);                                                     // skip descriptors completed without an interrupt
+    if ((state->txQueueCnt == 0) && (state->txPending < (eth->DMACTDRLR + 1))) {      // keep the order of the queued packets
+        ETHHW_FillTxDesc(eth, buf, len, txOpts, tsCbPtr, tsCbArg);
+        ret = ETHHW_TX_OK;
+    } else {
+        state->txStats.ringFull++;
+
+        // only zero-copy packets can wait, others would need their data copied
+        if ((txOpts & ETHHW_TXOPT_ZERO_COPY) && (state->txQueueCnt < state->txQueueLen)) {
+            ETHHW_TxQueueItem *item = state->txQueue + ((state->txQueueHead + state->txQueueCnt) % state->txQueueLen);
+            item->buf = buf;
+            item->len = len;
+            item->txOpts = txOpts;
+            item->tsCbPtr = tsCbPtr;
+            item->tsCbArg = tsCbArg;
+            state->txQueueCnt++;
+
+            state->txStats.queued++;
+            if (state->txQueueCnt > state->txStats.queueHighWater) {
+                state->txStats.queueHighWater = state->txQueueCnt;
+            }
+            ret = ETHHW_TX_QUEUED;
+        } else {
+            state->txStats.dropped++;
+            ret = ETHHW_TX_RING_FULL;
+        }
+    }
+
+    __set_PRIMASK(primask);
+    return ret;
+}
+
+const ETHHW_TxStats *ETHHW_GetTxStats(ETH_TypeDef *eth) {
+    return &ETHHW_GetState(eth)->txStats;
+}
+
+int ETHHW_TransmitSG(ETH_TypeDef *eth, const ETHHW_Segment *segs, uint16_t n, uint8_t txOpts, void *txOptArgs) {
+    ETHHW_State *state = ETHHW_GetState(eth);                // fetch state
+    uint16_t ringLen = eth->DMACTDRLR + 1;                   // TX ring length
+    ETHHW_DescFull *ring = (ETHHW_DescFull *)eth->DMACTDLAR; // TX ring
+
+    // count non-empty segments and the total packet length
+    uint16_t nonEmpty = 0;
+    uint32_t totalLen = 0;
+    for (uint16_t i = 0; i < n; i++) {
+        if (segs[i].len > 0) {
+            nonEmpty++;
+            totalLen += segs[i].len;
+        }
+    }
+
+    uint16_t descCnt = (nonEmpty + 1) / 2; // each descriptor carries two buffers
+    if ((descCnt == 0) || (descCnt > ringLen) || (totalLen > 0x7FFF)) {
+        return ETHHW_TX_ERROR;
+    }
+
+    uint32_t opts = 0;
+    if (((txOpts & ETHHW_TXOPT_CAPTURE_TS) == ETHHW_TXOPT_CAPTURE_TS) &&
+        (txOptArgs != NULL)) { // arguments are mandatory
+        opts |= ETH_DMATXNDESCRF_TTSE;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    // all descriptors must be completed, and queued packets go first
+    ETHHW_CompleteTx(eth, false);
+    uint16_t firstIdx = state->nextTxDescIdx;
+    if ((state->txQueueCnt > 0) || ((state->txPending + descCnt) > ringLen)) {
+        state->txStats.ringFull++;
+        state->txStats.dropped++;
+        __set_PRIMASK(primask);
+        return ETHHW_TX_RING_FULL;
+    }
+
+    uint16_t txCntr = ++state->txCntSent; // sequence number of the packet
+    state->txPending += descCnt;
+    bool ioc = ETHHW_TxIocRequired(state, txOpts & ETHHW_TXOPT_INTERRUPT_ON_COMPLETION);
+    uint16_t idx = firstIdx;
+    uint16_t segIdx = 0;
+    ETHHW_DescFull *bd = NULL;
+
+    for (uint16_t d = 0; d < descCnt; d++) {
+        bd = ring + idx;
+
+        ETHHW_ReleaseTxBuf(bd); // the previous zero-copy buffer of the descriptor is surely done
+
+        // erase possible old descriptor data
+        memset(bd, 0, sizeof(ETHHW_Desc)); // DON'T erase extension
+        bd->ext.tsCbPtr = 0;
+        bd->ext.tsCbArg = 0;
+        bd->ext.txCntr = txCntr;
+
+        // fetch the next one or two non-empty segments
+        const ETHHW_Segment *bufs[2] = {NULL, NULL};
+        for (uint8_t b = 0; (b < 2) && (segIdx < n); segIdx++) {
+            if (segs[segIdx].len > 0) {
+                bufs[b++] = &segs[segIdx];
+            }
+        }
+
+        bd->desc.DES0 = (uint32_t)bufs[0]->buf;
+        uint32_t DES2 = bufs[0]->len & 0x3FFF; // Buffer 1 length
+        if (bufs[1] != NULL) {
+            bd->desc.DES1 = (uint32_t)bufs[1]->buf;
+            DES2 |= (bufs[1]->len & 0x3FFF) << 16; // Buffer 2 length
+        }
+
+        uint32_t DES3 = 0;
+        if (d == 0) { // first descriptor: timestamping, checksum insertion and total length
+            DES2 |= opts;
+            DES3 |= ETH_DMATXNDESCRF_FD | ETH_DMATXNDESCRF_CIC_IPHDR_PAYLOAD_INSERT_PHDR_CALC | totalLen;
+        }
+        if (d == (descCnt - 1)) { // last descriptor: completion interrupt, timestamp is written back here
+            if (ioc) {
+                DES2 |= ETH_DMATXNDESCRF_IOC;
+            }
+            if (opts & ETH_DMATXNDESCRF_TTSE) {
+                ETHHW_OptArg_TxTsCap *arg = (ETHHW_OptArg_TxTsCap *)txOptArgs; // retrieve args
+                bd->ext.tsCbPtr = arg->txTsCbPtr;                              // fill-in extension fields
+                bd->ext.tsCbArg = arg->tag;
+            }
+            DES3 |= ETH_DMATXNDESCRF_LD;
+        }
+        bd->desc.DES2 = DES2;
+
+        // pass the following descriptors to the DMA right away, the first one only after the whole chain is ready
+        if (d > 0) {
+            bd->desc.DES3 = ETH_DMATXNDESCRF_OWN | DES3;
+        } else {
+            bd->desc.DES3 = DES3;
+        }
+
+        idx = (idx + 1) % ringLen;
+    }
+
+    __DMB(); // chain MUST be complete before releasing the first descriptor
+    ring[firstIdx].desc.DES3 |= ETH_DMATXNDESCRF_OWN;
+
+    state->nextTxDescIdx = idx; // advance index to next descriptor
 
     WRITE_REG(eth->DMACTDTPR, 0); // tail pointer WON'T STOP
+
+    __set_PRIMASK(primask);
+    return (int)(bd - ring);
+}
+
+bool ETHHW_IsTxDescReleased(ETH_TypeDef *eth, uint16_t idx) {
+    ETHHW_DescFull *bd = ((ETHHW_DescFull *)eth->DMACTDLAR) + idx;
+    return ETHHW_DESC_OWNED_BY_APPLICATION(bd);
 }
 
 // -----------------
@@ -546,6 +1079,182 @@ void ETHHW_SetLinkProperties(ETH_TypeDef *eth, bool fastEthernet, bool fullDuple
     eth->MACCR = reg;
 }
 
+// compute the hash table bin of a MAC address: upper 6 bits of the bit-reversed Ethernet CRC
+static uint8_t ETHHW_McastHashBin(const uint8_t *mac) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (uint8_t i = 0; i < 6; i++) {
+        crc ^= mac[i];
+        for (uint8_t b = 0; b < 8; b++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+        }
+    }
+    return __RBIT(~crc) >> 26;
+}
+
+// get the high register of a perfect match address slot (MACAxHR, followed by MACAxLR)
+static __IO uint32_t *ETHHW_McastPerfectReg(ETH_TypeDef *eth, uint8_t slot) {
+    return &eth->MACA1HR + 2 * slot;
+}
+
+bool ETHHW_AddMulticastFilter(ETH_TypeDef *eth, const uint8_t *mac) {
+    ETHHW_McastFilter *mcf = &ETHHW_GetState(eth)->mcFilter;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    // look for the address among the perfect matches, occupy a free slot if not found
+    int8_t freeSlot = -1;
+    for (uint8_t i = 0; i < ETHHW_MCAST_PERFECT_CNT; i++) {
+        if ((mcf->perfectRef[i] > 0) && (memcmp(mcf->perfectAddr[i], mac, 6) == 0)) {
+            bool ok = mcf->perfectRef[i] < UINT8_MAX;
+            mcf->perfectRef[i] += ok ? 1 : 0;
+            __set_PRIMASK(primask);
+            return ok;
+        } else if ((mcf->perfectRef[i] == 0) && (freeSlot < 0)) {
+            freeSlot = i;
+        }
+    }
+
+    bool ok = true;
+    if (freeSlot >= 0) {
+        memcpy(mcf->perfectAddr[freeSlot], mac, 6);
+        mcf->perfectRef[freeSlot] = 1;
+
+        __IO uint32_t *reg = ETHHW_McastPerfectReg(eth, freeSlot);
+        reg[1] = mac[0] | (mac[1] << 8) | (mac[2] << 16) | (mac[3] << 24); // MACAxLR
+        reg[0] = ETH_MACA1HR_AE | mac[4] | (mac[5] << 8);                   // MACAxHR, enable
+    } else {
+        // fall back to the hash table
+        uint8_t bin = ETHHW_McastHashBin(mac);
+        if (mcf->hashRef[bin] < UINT8_MAX) {
+            mcf->hashRef[bin]++;
+            __IO uint32_t *ht = (bin < 32) ? &eth->MACHT0R : &eth->MACHT1R;
+            SET_BIT(*ht, 1 << (bin & 0x1F));
+        } else {
+            ok = false;
+        }
+    }
+
+    __set_PRIMASK(primask);
+    return ok;
+}
+
+bool ETHHW_RemoveMulticastFilter(ETH_TypeDef *eth, const uint8_t *mac) {
+    ETHHW_McastFilter *mcf = &ETHHW_GetState(eth)->mcFilter;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    bool found = false;
+    for (uint8_t i = 0; i < ETHHW_MCAST_PERFECT_CNT; i++) {
+        if ((mcf->perfectRef[i] > 0) && (memcmp(mcf->perfectAddr[i], mac, 6) == 0)) {
+            if (--mcf->perfectRef[i] == 0) {
+                *ETHHW_McastPerfectReg(eth, i) = 0; // disable the slot
+            }
+            found = true;
+            break;
+        }
+    }
+
+    if (!found) {
+        uint8_t bin = ETHHW_McastHashBin(mac);
+        if (mcf->hashRef[bin] > 0) {
+            if (--mcf->hashRef[bin] == 0) { // no other address falls into this bin
+                __IO uint32_t *ht = (bin < 32) ? &eth->MACHT0R : &eth->MACHT1R;
+                CLEAR_BIT(*ht, 1 << (bin & 0x1F));
+            }
+            found = true;
+        }
+    }
+
+    __set_PRIMASK(primask);
+    return found;
+}
+
+void ETHHW_SetPassAllMulticast(ETH_TypeDef *eth, bool en) {
+    if (en) {
+        SET_BIT(eth->MACPFR, ETH_MACPFR_PM);
+    } else {
+        CLEAR_BIT(eth->MACPFR, ETH_MACPFR_PM);
+    }
+}
+
+// get the control register of an L3/L4 filter, followed by MACL4AxR, two reserved words and MACL3A0..3RxR
+static __IO uint32_t *ETHHW_L3L4FilterReg(ETH_TypeDef *eth, uint8_t idx) {
+    return &eth->MACL3L4C0R + idx * (&eth->MACL3L4C1R - &eth->MACL3L4C0R);
+}
+
+bool ETHHW_SetL3L4Rule(ETH_TypeDef *eth, uint8_t idx, const ETHHW_L3L4Rule *rule) {
+    if (idx >= ETHHW_L3L4_FILTER_CNT) {
+        return false;
+    }
+
+    ETHHW_State *state = ETHHW_GetState(eth);
+    if (rule != NULL) {
+        state->l3l4Rules[idx] = *rule;
+    } else {
+        memset(&state->l3l4Rules[idx], 0, sizeof(ETHHW_L3L4Rule));
+    }
+    rule = &state->l3l4Rules[idx];
+
+    // assemble the control word
+    uint32_t ctrl = 0;
+    if (rule->ipDstPrefix > 0) {
+        uint8_t prefix = (rule->ipDstPrefix > 32) ? 32 : rule->ipDstPrefix;
+        ctrl |= ETH_MACL3L4CR_L3DAM | ((32 - prefix) << ETH_MACL3L4CR_L3HDBM_Pos); // match destination address, mask the lower bits
+    }
+    if (rule->l4Proto != ETHHW_L4_ANY) {
+        ctrl |= (rule->l4Proto == ETHHW_L4_UDP) ? ETH_MACL3L4CR_L4PEN : 0; // TCP or UDP
+        if (rule->dstPort != 0) {
+            ctrl |= ETH_MACL3L4CR_L4DPM;
+        }
+    }
+
+    // a rule not matching anything is disabled
+    bool enabled = (ctrl & (ETH_MACL3L4CR_L3DAM | ETH_MACL3L4CR_L4DPM)) != 0;
+
+    __IO uint32_t *regs = ETHHW_L3L4FilterReg(eth, idx);
+    regs[0] = 0;                                                 // MACL3L4CxR: disable while reprogramming
+    regs[1] = ((uint32_t)rule->dstPort) << ETH_MACL4AR_L4DP_Pos; // MACL4AxR: destination port
+    regs[5] = rule->ipDst;                                       // MACL3A1RxR: destination address
+    regs[0] = enabled ? ctrl : 0;                                // MACL3L4CxR: enable
+
+    // filtering is active if any rule is enabled
+    bool anyEnabled = false;
+    for (uint8_t i = 0; i < ETHHW_L3L4_FILTER_CNT; i++) {
+        anyEnabled |= (ETHHW_L3L4FilterReg(eth, i)[0] & (ETH_MACL3L4CR_L3DAM | ETH_MACL3L4CR_L4DPM)) != 0;
+    }
+    if (anyEnabled) {
+        SET_BIT(eth->MACPFR, ETH_MACPFR_IPFE);
+    } else {
+        CLEAR_BIT(eth->MACPFR, ETH_MACPFR_IPFE);
+    }
+
+    state->l3l4Hits[idx] = 0;
+    return true;
+}
+
+void ETHHW_ClearL3L4Rules(ETH_TypeDef *eth) {
+    for (uint8_t i = 0; i < ETHHW_L3L4_FILTER_CNT; i++) {
+        ETHHW_SetL3L4Rule(eth, i, NULL);
+    }
+}
+
+void ETHHW_SetL3L4PtpOnly(ETH_TypeDef *eth) {
+    ETHHW_L3L4Rule event = {.l4Proto = ETHHW_L4_UDP, .dstPort = 319};
+    ETHHW_L3L4Rule general = {.l4Proto = ETHHW_L4_UDP, .dstPort = 320};
+    ETHHW_SetL3L4Rule(eth, 0, &event);
+    ETHHW_SetL3L4Rule(eth, 1, &general);
+}
+
+const ETHHW_L3L4Rule *ETHHW_GetL3L4Rules(ETH_TypeDef *eth) {
+    return ETHHW_GetState(eth)->l3l4Rules;
+}
+
+const uint32_t *ETHHW_GetL3L4Hits(ETH_TypeDef *eth) {
+    return ETHHW_GetState(eth)->l3l4Hits;
+}
+
 uint32_t ETHHW_ReadPHYRegister(ETH_TypeDef *eth, uint32_t PHYAddr, uint32_t PHYReg, uint32_t *pRegValue) {
     uint32_t tmpreg;
 
@@ -624,17 +1333,69 @@ uint32_t ETHHW_WritePHYRegister(ETH_TypeDef *eth, uint32_t PHYAddr,
 // subsecond rollover control (1 = rollover on 10^9-1 nsec) #define
 // ETH_PTP_FLAG_TSE ((uint32_t)(1 << 0)) // global timestamp enable flag
 
+// assemble the MACTSCR bits selecting the timestamped messages
+static uint32_t ETHHW_PTPSnapshotBits(ETH_TypeDef *eth) {
+    ETHHW_State *state = ETHHW_GetState(eth);
+
+    uint32_t bits = 0;
+    switch (state->ptpSnapMode) {
+    case ETHHW_PTP_SNAP_E2E_EVENTS:
+        bits = 0b10 << ETH_MACTSCR_SNAPTYPSEL_Pos; // Sync, Delay_Req
+        break;
+    case ETHHW_PTP_SNAP_P2P_EVENTS:
+        bits = (0b01 << ETH_MACTSCR_SNAPTYPSEL_Pos) | ETH_MACTSCR_TSEVNTENA; // Sync, Pdelay_Req, Pdelay_Resp
+        break;
+    default:
+        bits = 0b01 << ETH_MACTSCR_SNAPTYPSEL_Pos; // all messages
+        break;
+    }
+
+    if (state->ptpTransports & ETHHW_PTP_TRANSPORT_L2) {
+        bits |= ETH_MACTSCR_TSIPENA;
+    }
+    if (state->ptpTransports & ETHHW_PTP_TRANSPORT_UDP_IPV4) {
+        bits |= ETH_MACTSCR_TSIPV4ENA;
+    }
+
+    return bits;
+}
+
+#define ETHHW_PTP_SNAPSHOT_MASK (ETH_MACTSCR_SNAPTYPSEL | ETH_MACTSCR_TSMSTRENA | ETH_MACTSCR_TSEVNTENA | ETH_MACTSCR_TSIPENA | ETH_MACTSCR_TSIPV4ENA | ETH_MACTSCR_TSIPV6ENA)
+
 void ETHHW_EnablePTPTimeStamping(ETH_TypeDef *eth) {
     __IO uint32_t tmpreg = eth->MACTSCR;
 
-    tmpreg = 0b01 << ETH_MACTSCR_SNAPTYPSEL_Pos;
-    tmpreg |= ETH_MACTSCR_TSIPV4ENA | ETH_MACTSCR_TSIPENA |
-              ETH_MACTSCR_TSVER2ENA | ETH_MACTSCR_TSENA |
+    tmpreg = ETHHW_PTPSnapshotBits(eth);
+    tmpreg |= ETH_MACTSCR_TSVER2ENA | ETH_MACTSCR_TSENA |
               ETH_MACTSCR_TSCTRLSSR; // turn on relevant flags
 
     eth->MACTSCR = tmpreg;
 }
 
+void ETHHW_SetPTPSnapshotMode(ETH_TypeDef *eth, uint8_t mode, uint8_t transports) {
+    ETHHW_State *state = ETHHW_GetState(eth);
+    state->ptpSnapMode = mode;
+    state->ptpTransports = transports;
+
+    // alter only the message selection, keep timestamping and correction settings
+    __IO uint32_t tmpreg = eth->MACTSCR;
+    tmpreg &= ~ETHHW_PTP_SNAPSHOT_MASK;
+    tmpreg |= ETHHW_PTPSnapshotBits(eth);
+    eth->MACTSCR = tmpreg;
+
+    memset(&state->rxTsStats, 0, sizeof(ETHHW_RxTsStats));
+}
+
+void ETHHW_GetPTPSnapshotMode(ETH_TypeDef *eth, uint8_t *mode, uint8_t *transports) {
+    ETHHW_State *state = ETHHW_GetState(eth);
+    *mode = state->ptpSnapMode;
+    *transports = state->ptpTransports;
+}
+
+const ETHHW_RxTsStats *ETHHW_GetRxTsStats(ETH_TypeDef *eth) {
+    return &ETHHW_GetState(eth)->rxTsStats;
+}
+
 void ETHHW_DisablePTPTimeStamping(ETH_TypeDef *eth) {
     __IO uint32_t tmpreg = eth->MACTSCR;
 
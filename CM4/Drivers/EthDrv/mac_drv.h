@@ -9,12 +9,131 @@
 #define MODEINIT_SPEED_10MBPS (0)
 #define MODEINIT_SPEED_100MBPS (1)
 
-// MUST BE 4-BYTE ALIGNED!
+// entry of the software TX overflow queue (zero-copy transmissions only)
+typedef struct {
+    const uint8_t *buf; // packet data
+    uint16_t len;       // packet length
+    uint8_t txOpts;     // transmit options (ETHHW_TxOpt)
+    uint8_t pad0;
+    uint32_t tsCbPtr;   // pointer to timestamp callback function
+    uint32_t tsCbArg;   // user-defined timestamp parameter
+} ETHHW_TxQueueItem;
+
+// transmit statistics
 typedef struct {
-    uint16_t nextTxDescIdx; // index of next available TX descriptor
-    uint16_t txCntSent;     // sequence number of last transmitted packet
-    uint16_t txCntAcked;    // last transmission acknowledged by interrupt
+    uint32_t ringFull;       // transmissions not passed to the DMA right away (ring full or packets already waiting)
+    uint32_t queued;         // packets put into the overflow queue
+    uint32_t dropped;        // packets rejected, both the ring and the overflow queue were full
+    uint16_t queueHighWater; // maximum overflow queue occupancy
     uint16_t pad0;
+} ETHHW_TxStats;
+
+#define ETHHW_TX_TS_RING_LEN (16) // length of the TX timestamp completion ring, MUST be a power of 2
+
+// TX timestamp completion record
+typedef struct {
+    uint32_t tsCbPtr; // pointer to timestamp callback function
+    uint32_t tsCbArg; // user-defined timestamp parameter
+    uint32_t ts_s;    // timestamp seconds
+    uint32_t ts_ns;   // timestamp nanoseconds
+} ETHHW_TxTsRecord;
+
+// interrupt statistics
+typedef struct {
+    uint32_t isrCnt;        // number of ETH interrupts
+    uint32_t isrLastCycles; // duration of the last interrupt [CPU cycles]
+    uint32_t isrMaxCycles;  // longest interrupt [CPU cycles]
+    uint32_t tsInIsr;       // TX timestamp callbacks invoked in the interrupt
+    uint32_t tsDeferred;    // TX timestamps passed to the dispatcher task
+    uint32_t tsRingFull;    // TX timestamps reported in the interrupt since the completion ring was full
+    uint32_t rxIrqCnt;      // interrupts signalling received frames
+    uint32_t txIrqCnt;      // interrupts signalling completed transmissions
+    uint32_t rxLatLastNs;   // reception-to-processing latency of the last timestamped frame [ns]
+    uint32_t rxLatMaxNs;    // maximum reception-to-processing latency [ns]
+} ETHHW_IsrStats;
+
+// abnormal interrupt statistics
+typedef struct {
+    uint32_t rxBufUnavail; // RX DMA suspended for the lack of free descriptors (RBU)
+    uint32_t rxStopped;    // RX DMA stopped unexpectedly (RPS)
+    uint32_t txStopped;    // TX DMA stopped unexpectedly (TPS)
+    uint32_t txUnderflow;  // MTL transmit queue underflows
+    uint32_t rxOverflow;   // MTL receive queue overflows, frames have been lost
+    uint32_t fatalBusErr;  // fatal bus errors (FBE)
+    uint32_t ctxDescErr;   // context descriptor errors (CDE)
+    uint32_t recoveries;   // DMA restarts with reinitialized rings
+} ETHHW_ErrStats;
+
+#define ETHHW_MCAST_PERFECT_CNT (3) // multicast addresses matched perfectly (MACA1..MACA3), further ones go to the hash table
+#define ETHHW_MCAST_HASH_BINS (64)  // bins of the multicast hash table (MACHT0R/MACHT1R)
+
+// multicast filter bookkeeping
+typedef struct {
+    uint8_t perfectAddr[ETHHW_MCAST_PERFECT_CNT][6]; // addresses in the perfect match registers
+    uint8_t perfectRef[ETHHW_MCAST_PERFECT_CNT];     // reference counts of the perfect match addresses (0: slot free)
+    uint8_t hashRef[ETHHW_MCAST_HASH_BINS];          // reference counts of the hash bins
+    uint8_t pad0[3];
+} ETHHW_McastFilter;
+
+#define ETHHW_L3L4_FILTER_CNT (2) // number of Layer 3/Layer 4 filters of the MAC
+
+// Layer 4 protocol of an L3/L4 filter rule
+typedef enum {
+    ETHHW_L4_ANY = 0, // no Layer 4 matching
+    ETHHW_L4_TCP,     // TCP segments
+    ETHHW_L4_UDP      // UDP datagrams
+} ETHHW_L4Proto;
+
+// L3/L4 filter rule, an IPv4 packet passes if it matches any enabled rule
+typedef struct {
+    uint8_t l4Proto;     // ETHHW_L4Proto
+    uint8_t ipDstPrefix; // number of leading destination address bits matched (0: any destination)
+    uint16_t dstPort;    // TCP/UDP destination port (0: any port of the protocol)
+    uint32_t ipDst;      // destination IPv4 address, first octet in the MSB
+} ETHHW_L3L4Rule;
+
+// RX timestamping statistics, every timestamped frame occupies an extra context descriptor
+typedef struct {
+    uint32_t frames;      // received frames
+    uint32_t timestamped; // received frames carrying a timestamp
+} ETHHW_RxTsStats;
+
+// interrupt moderation settings
+typedef struct {
+    uint16_t rxWatchdogUs; // delay of the RX interrupt after the first unsignalled frame [us] (0: interrupt on every frame)
+    uint16_t txIocEvery;   // request a TX completion interrupt on every Nth frame besides timestamped ones (0: only timestamped ones)
+} ETHHW_IrqModeration;
+
+// MUST BE 4-BYTE ALIGNED!
+typedef struct {
+    uint16_t nextTxDescIdx;     // index of next available TX descriptor
+    uint16_t txCntSent;         // sequence number of last transmitted packet
+    uint16_t txCntAcked;        // last transmission acknowledged by interrupt
+    uint16_t txQueueLen;        // capacity of the overflow queue
+    ETHHW_TxQueueItem *txQueue; // software TX overflow queue (NULL: disabled)
+    uint16_t txQueueHead;       // index of the oldest queued packet
+    uint16_t txQueueCnt;        // number of queued packets
+    uint16_t txDoneIdx;         // completion cursor: index of the oldest descriptor not yet completed
+    uint16_t txPending;         // number of descriptors passed to the DMA and not yet completed
+    uint16_t rxHeadIdx;         // software RX cursor: index of the oldest unprocessed RX descriptor
+    uint16_t txIocCnt;          // frames transmitted since the last TX completion interrupt request
+    ETHHW_IrqModeration irqMod; // interrupt moderation settings
+    ETHHW_TxStats txStats;      // transmit statistics
+    uint16_t txTsWr;            // write index of the TX timestamp completion ring (free-running, interrupt)
+    uint16_t txTsRd;            // read index of the TX timestamp completion ring (free-running, dispatcher task)
+    bool txTsInIsr;             // invoke TX timestamp callbacks directly in the interrupt
+    bool recoverPending;        // the DMA has stopped on an error, the rings are reinitialized by the next RX poll
+    uint8_t pad1[2];
+    ETHHW_TxTsRecord txTsRing[ETHHW_TX_TS_RING_LEN]; // TX timestamp completion ring
+    ETHHW_IsrStats isrStats;    // interrupt statistics
+    ETHHW_ErrStats errStats;    // abnormal interrupt statistics
+    ETHHW_McastFilter mcFilter; // multicast filter
+    ETHHW_L3L4Rule l3l4Rules[ETHHW_L3L4_FILTER_CNT]; // L3/L4 filter rules (zeroed: disabled)
+    uint32_t l3l4Hits[ETHHW_L3L4_FILTER_CNT];        // number of received packets matching each L3/L4 rule
+    uint8_t ptpSnapMode;        // PTP messages timestamped on reception (ETHHW_PtpSnapMode)
+    uint8_t ptpTransports;      // PTP transports timestamped on reception (ETHHW_PtpTransport flags)
+    uint16_t pad3;
+    ETHHW_RxTsStats rxTsStats;  // RX timestamping statistics
 } ETHHW_State;
 
 typedef struct {
@@ -23,6 +142,9 @@ typedef struct {
     uint8_t *bufPtr;                // pointer to RX and TX buffer area
     uint16_t blockSize;             // size of a single buffer
     uint8_t mac[6];                 // MAC-address
+    bool noTxBufs;                  // no TX bounce buffers follow the RX buffers, only zero-copy transmission is possible
+    ETHHW_TxQueueItem *txQueuePtr;  // optional software TX overflow queue drained from the TX-complete interrupt (NULL: none)
+    uint16_t txQueueLen;            // length of the overflow queue
     ETHHW_State *statePtr;          // area where ETHHW state is stored, MUST immediately precede rxRingPtr!
 } ETHHW_InitOpts;
 
@@ -38,6 +160,7 @@ typedef struct {
     uint16_t pad0;
     uint32_t tsCbPtr; // pointer to timestamp callback function
     uint32_t tsCbArg; // user-defined timestamp parameter
+    uint32_t txBuf;   // buffer owned by the TX descriptor until the DMA releases it (zero-copy transmission)
 } ETHHW_DescExt;
 
 // full descriptor (DMA descriptor + extension)
@@ -50,7 +173,9 @@ typedef struct {
 typedef enum {
     ETHHW_EVT_RX_NOTFY,
     ETHHW_EVT_RX_READ,
-    ETHHW_EVT_TX_DONE
+    ETHHW_EVT_TX_DONE,
+    ETHHW_EVT_TX_RELEASE, // a zero-copy TX buffer is not used anymore (always raised with interrupts disabled, do not free it right in the callback)
+    ETHHW_EVT_TX_TS_READY // TX timestamps are waiting in the completion ring, call ETHHW_DispatchTxTimestamps() (raised in the interrupt)
 } ETHHW_EventType; // TODO shouldn't start with zero
 
 typedef struct {
@@ -61,21 +186,29 @@ typedef struct {
             void *payload;  // pointer to received data
             uint32_t ts_s;  // timestamp seconds
             uint32_t ts_ns; // timestamp nanoseconds
+            void *spare;    // replacement buffer, filled by the callback when returning ETHHW_RET_RX_LOANED
         } rx;
         struct {
             uint32_t tag;   // some arbitrary tag
             uint32_t ts_s;  // timestamp seconds
             uint32_t ts_ns; // timestamp nanoseconds
         } tx;
+        struct {
+            void *buf; // buffer of a zero-copy transmission released by the DMA
+        } txRelease;
     } data;
 } ETHHW_EventDesc;
 
-#define ETHHW_RET_RX_PROCESSED (1)
+#define ETHHW_RX_IRQ_MASK (ETH_DMACIER_RIE | ETH_DMACIER_RBUE) // RX interrupts masked while the RX poll is in progress
+
+#define ETHHW_RET_RX_PROCESSED (1) // packet has been consumed, the buffer is reused
+#define ETHHW_RET_RX_LOANED (2)    // the buffer has been taken over, the descriptor is re-armed with the spare buffer
 
 typedef enum {
     ETHHW_TXOPT_NONE = 0b00,
     ETHHW_TXOPT_INTERRUPT_ON_COMPLETION = 0b01,
-    ETHHW_TXOPT_CAPTURE_TS = 0b11
+    ETHHW_TXOPT_CAPTURE_TS = 0b11,
+    ETHHW_TXOPT_ZERO_COPY = 0b100 // DMA reads the caller's buffer, which is handed back in an ETHHW_EVT_TX_RELEASE event
 } ETHHW_TxOpt;
 
 typedef struct {
@@ -83,14 +216,50 @@ typedef struct {
     uint32_t tag;       // arbitrary tagging
 } ETHHW_OptArg_TxTsCap;
 
+typedef enum {
+    ETHHW_TX_OK = 0,         // packet has been passed to the DMA
+    ETHHW_TX_QUEUED = 1,     // ring is full, packet has been put into the overflow queue
+    ETHHW_TX_RING_FULL = -1, // ring (and the overflow queue) is full, packet has not been accepted
+    ETHHW_TX_ERROR = -2      // packet cannot be transmitted (no bounce buffers, too many segments...)
+} ETHHW_TxStatus;
+
+typedef struct {
+    const uint8_t *buf; // segment data, MUST remain valid until the DMA releases the descriptor
+    uint16_t len;       // segment length
+} ETHHW_Segment;
+
 void ETHHW_Init(ETH_TypeDef *eth, ETHHW_InitOpts *init);
 void ETHHW_Start(ETH_TypeDef *eth);
-void ETHHW_Transmit(ETH_TypeDef *eth, const uint8_t *buf, uint16_t len, uint8_t txOpts, void *txOptArgs);
+ETHHW_TxStatus ETHHW_Transmit(ETH_TypeDef *eth, const uint8_t *buf, uint16_t len, uint8_t txOpts, void *txOptArgs); // transmit a packet without waiting for a descriptor
+int ETHHW_TransmitSG(ETH_TypeDef *eth, const ETHHW_Segment *segs, uint16_t n, uint8_t txOpts, void *txOptArgs);       // transmit a packet directly from the segments (two per descriptor), returns the index of the last descriptor or a negative ETHHW_TxStatus
+bool ETHHW_IsTxDescReleased(ETH_TypeDef *eth, uint16_t idx);                                                       // check if the DMA has released a TX descriptor
+void ETHHW_ReleaseTx(ETH_TypeDef *eth);                                                                            // hand back zero-copy TX buffers the DMA has finished with and push queued packets (task context)
+const ETHHW_TxStats *ETHHW_GetTxStats(ETH_TypeDef *eth);                                                           // get transmit statistics
 
-void ETHHW_ProcessRx(ETH_TypeDef *eth);
+void ETHHW_SetTxTsInIsr(ETH_TypeDef *eth, bool inIsr);         // invoke TX timestamp callbacks in the interrupt (lowest latency, default) or pass them to a dispatcher task
+bool ETHHW_GetTxTsInIsr(ETH_TypeDef *eth);                     // get TX timestamp callback mode
+void ETHHW_DispatchTxTimestamps(ETH_TypeDef *eth);             // invoke the callbacks of the completed TX timestamps (dispatcher task context)
+const ETHHW_IsrStats *ETHHW_GetIsrStats(ETH_TypeDef *eth);     // get interrupt statistics
+void ETHHW_ClearIsrStats(ETH_TypeDef *eth);                    // clear interrupt statistics
+void ETHHW_SetIrqModeration(ETH_TypeDef *eth, const ETHHW_IrqModeration *mod); // set interrupt moderation (RX watchdog is limited to 255 x 256 bus clock cycles)
+const ETHHW_IrqModeration *ETHHW_GetIrqModeration(ETH_TypeDef *eth);           // get interrupt moderation settings
+const ETHHW_ErrStats *ETHHW_GetErrStats(ETH_TypeDef *eth);                     // get abnormal interrupt statistics
+
+void ETHHW_ProcessRx(ETH_TypeDef *eth);                   // process all received packets
+bool ETHHW_PollRx(ETH_TypeDef *eth, uint16_t budget);     // process at most budget packets, returns true and re-enables the RX interrupts (ETHHW_RX_IRQ_MASK, masked by the ISR) if the ring has been drained
 
 void ETHHW_SetLinkProperties(ETH_TypeDef *eth, bool fastEthernet, bool fullDuplex);
 
+bool ETHHW_AddMulticastFilter(ETH_TypeDef *eth, const uint8_t *mac);    // let frames sent to a multicast MAC address in (reference counted)
+bool ETHHW_RemoveMulticastFilter(ETH_TypeDef *eth, const uint8_t *mac); // drop reference to a multicast MAC address, returns false if it has not been added
+void ETHHW_SetPassAllMulticast(ETH_TypeDef *eth, bool en);              // bypass the multicast filter
+
+bool ETHHW_SetL3L4Rule(ETH_TypeDef *eth, uint8_t idx, const ETHHW_L3L4Rule *rule); // set (NULL: disable) an L3/L4 filter rule, IPv4 packets matching no rule are dropped by the MAC while any rule is enabled; non-IP frames (ARP, L2 PTP) always pass
+void ETHHW_ClearL3L4Rules(ETH_TypeDef *eth);                                       // disable all L3/L4 filter rules, admit all IP traffic
+void ETHHW_SetL3L4PtpOnly(ETH_TypeDef *eth);                                       // admit only PTP over UDP (event port 319, general port 320) of the IP traffic
+const ETHHW_L3L4Rule *ETHHW_GetL3L4Rules(ETH_TypeDef *eth);                        // get the L3/L4 filter rules (ETHHW_L3L4_FILTER_CNT entries)
+const uint32_t *ETHHW_GetL3L4Hits(ETH_TypeDef *eth);                               // get the per-rule hit counters (ETHHW_L3L4_FILTER_CNT entries)
+
 void ETHHW_ISR(ETH_TypeDef *eth);
 
 uint32_t ETHHW_ReadPHYRegister(ETH_TypeDef *eth, uint32_t PHYAddr, uint32_t PHYReg, uint32_t *pRegValue);
@@ -117,7 +286,23 @@ typedef enum {
     ETHHW_PTP_PPS_16384Hz
 } ETHHW_PPS_FreqEnum;
 
-void ETHHW_EnablePTPTimeStamping(ETH_TypeDef *eth);                                          // Enable PTP timestamping (currently every frame received gets timestamped)
+// PTP messages timestamped on reception
+typedef enum {
+    ETHHW_PTP_SNAP_ALL_MSGS = 0, // every PTP message, both event and general ones
+    ETHHW_PTP_SNAP_E2E_EVENTS,   // Sync and Delay_Req (end-to-end delay mechanism)
+    ETHHW_PTP_SNAP_P2P_EVENTS    // Sync, Pdelay_Req and Pdelay_Resp (peer-to-peer delay mechanism, gPTP)
+} ETHHW_PtpSnapMode;
+
+// PTP transports timestamped on reception
+typedef enum {
+    ETHHW_PTP_TRANSPORT_L2 = 0b01,      // PTP directly over Ethernet (e.g. gPTP)
+    ETHHW_PTP_TRANSPORT_UDP_IPV4 = 0b10 // PTP over UDP/IPv4
+} ETHHW_PtpTransport;
+
+void ETHHW_EnablePTPTimeStamping(ETH_TypeDef *eth);                                          // Enable PTP timestamping of the messages selected by the snapshot mode (default: all PTP messages over L2 and UDP/IPv4)
+void ETHHW_SetPTPSnapshotMode(ETH_TypeDef *eth, uint8_t mode, uint8_t transports);          // Select the received PTP messages (ETHHW_PtpSnapMode) and transports (ETHHW_PtpTransport flags) being timestamped, clears the RX timestamping statistics
+void ETHHW_GetPTPSnapshotMode(ETH_TypeDef *eth, uint8_t *mode, uint8_t *transports);        // Get the snapshot mode and transports
+const ETHHW_RxTsStats *ETHHW_GetRxTsStats(ETH_TypeDef *eth);                                 // Get RX timestamping statistics
 void ETHHW_DisablePTPTimeStamping(ETH_TypeDef *eth);                                         // Disable PTP timestamping
 void ETHHW_InitPTPTime(ETH_TypeDef *eth, uint32_t sec, uint32_t nsec);                       // Initialize PTP clock time
 void ETHHW_EnablePTPFineCorr(ETH_TypeDef *eth, bool enFineCorr);                             // Enable fine correction method
@@ -66,10 +66,22 @@
 
 #include <flexptp/servo/pid_controller.h>
 
+#include "shared_state.h"
+
 #define PTP_SERVO_INIT() pid_ctrl_init()
 #define PTP_SERVO_DEINIT() pid_ctrl_deinit()
-#define PTP_SERVO_RESET() pid_ctrl_reset()
-#define PTP_SERVO_RUN(d, pscd) pid_ctrl_run(d, pscd)
+#define PTP_SERVO_RESET()           \
+    do {                            \
+        pid_ctrl_reset();           \
+        shared_state_servo_reset(); \
+    } while (0)
+#define PTP_SERVO_RUN(d, pscd)                           \
+    ({                                                   \
+        float tuning_ppb = pid_ctrl_run(d, pscd);        \
+        shared_state_publish_servo((d), tuning_ppb);     \
+        shared_state_push_sync((d), tuning_ppb, (pscd)); \
+        tuning_ppb;                                      \
+    }) // also publish the servo output and the sync cycle record to the CM7 core
 
 // Optionally add interactive, tokenizing CLI-support
 // - CLI_REG_CMD(cmd_hintline,n_cmd,n_min_arg,cb): function for registering CLI-commands
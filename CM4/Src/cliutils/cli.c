@@ -46,6 +46,8 @@ static bool sInitialized = false; // CLI is initialized
 
 static osMutexId_t modifyMtx = NULL; // mutex protecting the command database
 
+static void cli_recv_cb(ICC_ChannelId ch, ICCQueue *q); // ICC input processing
+
 // ---------------------------
 
 // register and initialize task
@@ -56,6 +58,9 @@ void cli_init() {
     // initialize FIFO
     bfifo_create(&sInputFifo, sFifoMem, CLI_INPUT_FIFO_BUFSIZE);
 
+    // receive keystrokes on the CLI input channel
+    icc_register_recv_cb(ICC_CH_CLI_INPUT, cli_recv_cb);
+
     // initialize modification mutex
     modifyMtx = osMutexNew(NULL);
 
@@ -447,17 +452,13 @@ void task_cli(void *pParam) {
     }
 }
 
-void icc_recv_cb(const uint8_t *data, uint32_t size) {
+static void cli_recv_cb(ICC_ChannelId ch, ICCQueue *q) {
     if (sInitialized) { // push only, if the CLI had been initialized before
-        ICCQueue *q = icc_get_inbound_pipe();
-        uint16_t avail = iccq_avail(q);
-        if (avail > 0) {
-            for (uint16_t i = 0; i < avail; i++) {
-                char c;
-                iccq_top(q, &c);
-                iccq_pop(q);
-                bfifo_push(&sInputFifo, &c, 1);
-            }
+        const void *p;
+        uint32_t len;
+        while ((len = iccq_peek_contig(q, &p)) > 0) {
+            bfifo_push(&sInputFifo, (const uint8_t *)p, len);
+            iccq_pop_n(q, NULL, len);
         }
     }
 }
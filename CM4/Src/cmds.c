@@ -2,14 +2,24 @@
 #include "flexptp/task_ptp.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <FreeRTOS.h>
 #include <cmsis_os2.h>
 
+#include <stm32h7xx_hal.h>
+
 #include <cliutils/cli.h>
 #include <standard_output/standard_output.h>
 
+#include <EthDrv/mac_drv.h>
 #include <EthDrv/phy_drv/phy_common.h>
+#ifdef ETH_ETHERLIB
+#include <EthDrv/eth_drv_etherlib.h>
+#endif
+
+#include <ICC/icc.h>
+#include <ICC/icc_bench.h>
 
 #include <etherlib/etherlib.h>
 
@@ -34,6 +44,141 @@ CMD_FUNCTION(phy_info) {
     return 0;
 }
 
+CMD_FUNCTION(eth_txstat) {
+    const ETHHW_TxStats *stats = ETHHW_GetTxStats(ETH);
+    MSG("Ring full: %u, queued: %u, dropped: %u, max. queue occupancy: %u\n", stats->ringFull, stats->queued, stats->dropped, stats->queueHighWater);
+    return 0;
+}
+
+CMD_FUNCTION(eth_txts) {
+    if (argc > 0) {
+        bool inIsr = !strcmp(ppArgs[0], "isr");
+        if (!inIsr && strcmp(ppArgs[0], "task")) {
+            return -1;
+        }
+        ETHHW_SetTxTsInIsr(ETH, inIsr);
+        ETHHW_ClearIsrStats(ETH); // compare the interrupt durations of the two modes
+    }
+
+    const ETHHW_IsrStats *stats = ETHHW_GetIsrStats(ETH);
+    uint32_t cyclesPerUs = SystemCoreClock / 1000000;
+    MSG("TX timestamp callbacks: %s\n", ETHHW_GetTxTsInIsr(ETH) ? "in ISR" : "in task");
+    MSG("ISR count: %u, last: %u ns, max: %u ns\n", stats->isrCnt, stats->isrLastCycles * 1000 / cyclesPerUs, stats->isrMaxCycles * 1000 / cyclesPerUs);
+    MSG("Timestamps in ISR: %u, deferred: %u, ring full: %u\n", stats->tsInIsr, stats->tsDeferred, stats->tsRingFull);
+    return 0;
+}
+
+CMD_FUNCTION(eth_irqmod) {
+    if (argc > 0) {
+        if (argc < 2) {
+            return -1;
+        }
+        ETHHW_IrqModeration mod = {.rxWatchdogUs = atoi(ppArgs[0]), .txIocEvery = atoi(ppArgs[1])};
+        ETHHW_SetIrqModeration(ETH, &mod);
+        ETHHW_ClearIsrStats(ETH); // restart the latency measurement
+    }
+
+    const ETHHW_IrqModeration *mod = ETHHW_GetIrqModeration(ETH);
+    MSG("RX watchdog: %u us, TX IOC on every %u. frame\n", mod->rxWatchdogUs, mod->txIocEvery);
+
+    // sample the interrupt counters for a second
+    const ETHHW_IsrStats *stats = ETHHW_GetIsrStats(ETH);
+    uint32_t isrCnt = stats->isrCnt, rxIrqCnt = stats->rxIrqCnt, txIrqCnt = stats->txIrqCnt;
+    osDelay(1000);
+    MSG("Interrupt rate: %u/s (RX: %u/s, TX: %u/s)\n", stats->isrCnt - isrCnt, stats->rxIrqCnt - rxIrqCnt, stats->txIrqCnt - txIrqCnt);
+    MSG("RX latency: last: %u ns, max: %u ns\n", stats->rxLatLastNs, stats->rxLatMaxNs);
+    return 0;
+}
+
+CMD_FUNCTION(eth_errstat) {
+    const ETHHW_ErrStats *stats = ETHHW_GetErrStats(ETH);
+    MSG("RX buffer unavailable: %u, RX queue overflow: %u, TX queue underflow: %u\n", stats->rxBufUnavail, stats->rxOverflow, stats->txUnderflow);
+    MSG("RX stopped: %u, TX stopped: %u, context desc. error: %u\n", stats->rxStopped, stats->txStopped, stats->ctxDescErr);
+    MSG("Fatal bus error: %u, DMA recoveries: %u\n", stats->fatalBusErr, stats->recoveries);
+    return 0;
+}
+
+CMD_FUNCTION(eth_mcast) {
+    if (argc < 1) {
+        return -1;
+    }
+
+    bool passAll = !strcmp(ppArgs[0], "all");
+    if (!passAll && strcmp(ppArgs[0], "filter")) {
+        return -1;
+    }
+    ETHHW_SetPassAllMulticast(ETH, passAll);
+    MSG("Multicast: %s\n", passAll ? "pass all" : "hardware filtered");
+    return 0;
+}
+
+CMD_FUNCTION(eth_l3l4) {
+    if (argc > 0) {
+        if (!strcmp(ppArgs[0], "off")) {
+            ETHHW_ClearL3L4Rules(ETH);
+        } else if (!strcmp(ppArgs[0], "ptp")) {
+            ETHHW_SetL3L4PtpOnly(ETH);
+        } else if (argc >= 3) {
+            bool udp = !strcmp(ppArgs[1], "udp");
+            if (!udp && strcmp(ppArgs[1], "tcp")) {
+                return -1;
+            }
+            ETHHW_L3L4Rule rule = {.l4Proto = udp ? ETHHW_L4_UDP : ETHHW_L4_TCP, .dstPort = atoi(ppArgs[2])};
+            if (!ETHHW_SetL3L4Rule(ETH, atoi(ppArgs[0]), &rule)) {
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+    }
+
+    const ETHHW_L3L4Rule *rules = ETHHW_GetL3L4Rules(ETH);
+    const uint32_t *hits = ETHHW_GetL3L4Hits(ETH);
+    for (uint8_t i = 0; i < ETHHW_L3L4_FILTER_CNT; i++) {
+        const ETHHW_L3L4Rule *r = rules + i;
+        const char *proto = (r->l4Proto == ETHHW_L4_UDP) ? "UDP" : ((r->l4Proto == ETHHW_L4_TCP) ? "TCP" : "IP");
+        MSG("#%u: %s port %u, dst. %u.%u.%u.%u/%u, hits: %u\n", i, proto, r->dstPort,
+            (r->ipDst >> 24) & 0xFF, (r->ipDst >> 16) & 0xFF, (r->ipDst >> 8) & 0xFF, r->ipDst & 0xFF, r->ipDstPrefix, hits[i]);
+    }
+    return 0;
+}
+
+CMD_FUNCTION(eth_rxts) {
+    static const char *modeNames[] = {"all", "e2e", "p2p"};
+    static const char *transportNames[] = {"none", "l2", "udp", "both"};
+
+    uint8_t mode, transports;
+    ETHHW_GetPTPSnapshotMode(ETH, &mode, &transports);
+
+    if (argc > 0) {
+        uint8_t i;
+        for (i = 0; (i < 3) && strcmp(ppArgs[0], modeNames[i]); i++) {
+        }
+        if (i == 3) {
+            return -1;
+        }
+        mode = i;
+
+        if (argc > 1) {
+            for (i = 1; (i < 4) && strcmp(ppArgs[1], transportNames[i]); i++) {
+            }
+            if (i == 4) {
+                return -1;
+            }
+            transports = i; // index equals the ETHHW_PtpTransport flags
+        }
+
+        ETHHW_SetPTPSnapshotMode(ETH, mode, transports);
+    }
+
+    const ETHHW_RxTsStats *stats = ETHHW_GetRxTsStats(ETH);
+    uint32_t slots = stats->frames + stats->timestamped; // descriptors consumed
+    MSG("RX timestamping: %s messages, transport: %s\n", modeNames[mode % 3], transportNames[transports & 0b11]);
+    MSG("Frames: %u, timestamped: %u, ring slots taken by context descriptors: %u%%\n", stats->frames, stats->timestamped,
+        (slots > 0) ? (stats->timestamped * 100 / slots) : 0);
+    return 0;
+}
+
 #ifdef ETH_ETHERLIB
 
 CMD_FUNCTION(print_ip) {
@@ -58,6 +203,21 @@ CMD_FUNCTION(eth_mem) {
     return 0;
 }
 
+CMD_FUNCTION(eth_loan) {
+    if (argc > 0) {
+        int en = ONOFF(ppArgs[0]);
+        if (en < 0) {
+            return -1;
+        }
+        ethdrv_set_rx_loan(en);
+    }
+
+    const EthDrv_RxStats *stats = ethdrv_get_rx_stats();
+    MSG("RX buffer loaning: %s\n", ethdrv_get_rx_loan() ? "on" : "off");
+    MSG("Loaned: %u, copied: %u, returned: %u, min. free spares: %u\n", stats->loaned, stats->copied, stats->returned, stats->minFree);
+    return 0;
+}
+
 CMD_FUNCTION(eth_arpc) {
     arpc_dump(E.ethIntf->arpc);
     return 0;
@@ -84,18 +244,171 @@ CMD_FUNCTION(start_flexptp) {
 
 
 
+CMD_FUNCTION(icc_coalesce) {
+    if (argc > 0) {
+        int en = ONOFF(ppArgs[0]);
+        if (en < 0) {
+            return -1;
+        }
+        icc_set_coalescing(en ? ICC_COALESCE_ADAPTIVE : ICC_COALESCE_OFF);
+    }
+
+    MSG("ICC doorbell coalescing: %s\n", (icc_get_coalescing() == ICC_COALESCE_ADAPTIVE) ? "adaptive" : "off");
+    return 0;
+}
+
+CMD_FUNCTION(icc_doorbell) {
+    static uint32_t lastTick = 0;
+    static ICC_DoorbellStats lastStats[ICC_CH_COUNT];
+
+    uint32_t tick = osKernelGetTickCount();
+    uint32_t elapsedMs = tick - lastTick;
+
+    MSG("Outbound doorbells (%u ms since last query):\n", elapsedMs);
+    for (uint8_t ch = 0; ch < ICC_CH_COUNT; ch++) {
+        const ICC_ChannelDesc *desc = icc_get_channel_desc(ch);
+        if (desc->dir != ICC_DIR_SEVENBOUND) {
+            continue;
+        }
+
+        // compute rates over the period since the last query
+        const ICC_DoorbellStats *stats = icc_get_doorbell_stats(ch);
+        uint32_t rings = stats->rings - lastStats[ch].rings;
+        uint32_t bytes = stats->bytes - lastStats[ch].bytes;
+        uint32_t ringsPerSec = (elapsedMs > 0) ? (uint32_t)(((uint64_t)rings * 1000) / elapsedMs) : 0;
+        uint32_t bytesPerRing = (rings > 0) ? (bytes / rings) : 0;
+
+        MSG(" %-10s notifies: %u, rings: %u (%u/s), bytes: %u (%u/ring), SEVs: %u\n",
+            desc->name, stats->notifies - lastStats[ch].notifies, rings, ringsPerSec, bytes, bytesPerRing, stats->sevs - lastStats[ch].sevs);
+
+        lastStats[ch] = *stats;
+    }
+    lastTick = tick;
+
+    return 0;
+}
+
+CMD_FUNCTION(icc_stats) {
+    static const char *dirs[] = {"M4->M7", "M7->M4"};
+
+    for (uint8_t ch = 0; ch < ICC_CH_COUNT; ch++) {
+        const ICC_ChannelDesc *desc = icc_get_channel_desc(ch);
+        const ICCQueue *q = icc_get_channel(ch);
+        const ICC_NotifyStats *ns = icc_get_notify_stats(ch);
+
+        MSG("%-10s (%s, %u bytes)\n"
+            " pushed: %u, popped: %u, pending: %u, high-water: %u (%u%%), push fails: %u\n"
+            " notifications sent: %u, received: %u, max. batch: %u\n",
+            desc->name, dirs[desc->dir], q->length,
+            q->pushed, q->popped, iccq_avail(q), q->highWater, (q->highWater * 100) / q->length, q->pushFails,
+            ns->sent, ns->received, ns->maxBatch);
+    }
+
+    return 0;
+}
+
+CMD_FUNCTION(icc_state) {
+    static const char *servoStates[] = {"inactive", "tracking", "locked"};
+
+    ICC_StateSnapshot s;
+    icc_state_read(&s);
+
+    MSG("Shared state (version %u, %u bytes):\n"
+        " syncs: %u, offset: %d ns, addend: %u, servo: %s (%f ppb)\n"
+        " link: %s (%u Mbps), IP: %u.%u.%u.%u\n",
+        s.version, s.size,
+        s.syncCnt, s.ptpOffsetNs, s.ptpAddend, servoStates[s.servoState], s.servoOutputPpb,
+        s.linkUp ? "UP" : "DOWN", s.linkSpeed,
+        s.ipAddr & 0xFF, (s.ipAddr >> 8) & 0xFF, (s.ipAddr >> 16) & 0xFF, (s.ipAddr >> 24) & 0xFF);
+
+    return 0;
+}
+
+CMD_FUNCTION(icc_bench) {
+    if (!icc_bench_run()) {
+        MSG("Some benchmark messages have been lost!\n");
+    }
+    return 0;
+}
+
+CMD_FUNCTION(icc_ts) {
+    if (argc > 0) {
+        int en = ONOFF(ppArgs[0]);
+        if (en < 0) {
+            return -1;
+        }
+        icc_ts_enable(en);
+    }
+
+    const ICC_TsStats *stats = icc_ts_get_stats();
+    uint32_t cyclesPerUs = SystemCoreClock / 1000000;
+    MSG("Timestamp stream: %s\n pushed: %u, dropped: %u\n producer cost: last %u cycles (%u ns), max %u cycles (%u ns)\n",
+        icc_ts_is_enabled() ? "on" : "off", stats->pushed, stats->dropped,
+        stats->lastCycles, (stats->lastCycles * 1000) / cyclesPerUs, stats->maxCycles, (stats->maxCycles * 1000) / cyclesPerUs);
+    return 0;
+}
+
+typedef struct {
+    uint32_t startTick; // transfer start
+    uint32_t len;       // blob length
+} IccBlobTest;
+
+static void icc_blob_done(uint32_t blobId, bool ok, void *arg) {
+    const IccBlobTest *test = (const IccBlobTest *)arg;
+    uint32_t elapsedMs = osKernelGetTickCount() - test->startTick;
+    MSG("Blob %u %s: %u bytes in %u ms (%u kB/s)\n", blobId, ok ? "done" : "FAILED", test->len, elapsedMs,
+        (elapsedMs > 0) ? (test->len / elapsedMs) : 0);
+}
+
+CMD_FUNCTION(icc_blob) {
+    static IccBlobTest test;
+    static const char pattern[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz\r\n";
+
+    uint32_t len = (argc > 0) ? atoi(ppArgs[0]) : 16384;
+    test.startTick = osKernelGetTickCount();
+    test.len = len;
+
+    // stream a text pattern in pieces
+    icc_blob_begin(0);
+    while (len > 0) {
+        uint32_t pieceLen = (len < (sizeof(pattern) - 1)) ? len : (sizeof(pattern) - 1);
+        if (!icc_blob_write(pattern, pieceLen)) {
+            break;
+        }
+        len -= pieceLen;
+    }
+    icc_blob_end(icc_blob_done, &test);
+
+    return 0;
+}
+
 // ---------------------------------
 
 void cmd_init() {
     cli_register_command("osinfo \t\t\tPrint OS-related information", 1, 0, os_info);
     cli_register_command("phyinfo \t\t\tPrint Ethernet PHY information", 1, 0, phy_info);
     cli_register_command("flexptp \t\t\tStart flexPTP daemon", 1, 0, start_flexptp);
+    cli_register_command("icc coalesce [on|off] \t\t\tGet or set ICC doorbell coalescing", 2, 0, icc_coalesce);
+    cli_register_command("icc doorbell \t\t\tPrint ICC doorbell rate and bytes per doorbell", 2, 0, icc_doorbell);
+    cli_register_command("icc stats \t\t\tPrint ICC queue and notification statistics of both directions", 2, 0, icc_stats);
+    cli_register_command("icc state \t\t\tPrint the state snapshot shared with the CM7 core", 2, 0, icc_state);
+    cli_register_command("icc bench \t\t\tMeasure ICC latency and throughput", 2, 0, icc_bench);
+    cli_register_command("icc ts [on|off] \t\t\tGet or set the timestamp record stream to the CM7 core", 2, 0, icc_ts);
+    cli_register_command("icc blob [len] \t\t\tSend a test blob to the CM7 core's UART", 2, 0, icc_blob);
+    cli_register_command("eth txstat \t\t\tPrint transmit ring and overflow queue statistics", 2, 0, eth_txstat);
+    cli_register_command("eth txts [isr|task] \t\t\tGet or set where TX timestamp callbacks run, print ETH ISR duration", 2, 0, eth_txts);
+    cli_register_command("eth irqmod [<rxwd_us> <txioc_every>] \t\t\tGet or set interrupt moderation, print interrupt rate and RX latency", 2, 0, eth_irqmod);
+    cli_register_command("eth errstat \t\t\tPrint abnormal interrupt and DMA recovery statistics", 2, 0, eth_errstat);
+    cli_register_command("eth mcast {all|filter} \t\t\tPass all multicast frames or only the joined groups", 2, 1, eth_mcast);
+    cli_register_command("eth l3l4 [off|ptp|<idx> {udp|tcp} <port>] \t\t\tGet or set the L3/L4 filter rules, print hit counters", 2, 0, eth_l3l4);
+    cli_register_command("eth rxts [all|e2e|p2p] [l2|udp|both] \t\t\tGet or set the received PTP messages being timestamped, print context descriptor usage", 2, 0, eth_rxts);
 
 #ifdef ETH_ETHERLIB
     cli_register_command("ip \t\t\tPrint IP-address", 1, 0, print_ip);
     cli_register_command("eth tmr \t\t\tPrint EtherLib timer report", 2, 0, eth_tmr);
     cli_register_command("eth conns \t\t\tPrint active connections", 2, 0, eth_conns);
     cli_register_command("eth mem \t\t\tPrint EtherLib memory pool state", 2, 0, eth_mem);
+    cli_register_command("eth loan [on|off] \t\t\tGet or set zero-copy RX buffer loaning", 2, 0, eth_loan);
     cli_register_command("eth arpc \t\t\tPrint EtherLib ARP cache", 2, 0, eth_arpc);
     cli_register_command("eth cbdt \t\t\tPrint EtherLib CBD table", 2, 0, eth_cbdt);
 #endif
@@ -2,6 +2,8 @@
 
 #include <stm32h7xx_hal.h>
 
+#include <cmsis_os2.h>
+
 #include "EthDrv/eth_drv_etherlib.h"
 #include "etherlib/eth_interface.h"
 
@@ -9,6 +11,8 @@
 #include "etherlib/prefab/conn_blocks/icmp_connblock.h"
 #include "etherlib/utils.h"
 
+#include "shared_state.h"
+
 
 EthernetAddress msg_cb_addr = {0x01, 0x60, 0x00, 0x00, 0x00, 0x00};
 
@@ -74,6 +78,26 @@ void intercept_rx_frame(EthInterface *intf, const RawPckt *pckt) {
     MSG(ANSI_COLOR_RESET);
 }
 
+static osTimerId_t checkNetStateTmr;
+
+// publish link state and IP-address changes to the CM7 core
+void check_net_state(void *param) {
+    static LinkState prevLinkState = {false, false, 0, false};
+    static uint32_t prevIp = 0;
+
+    const LinkState *linkState = ethdrv_get_link_state();
+    if ((linkState->up != prevLinkState.up) || (linkState->speed != prevLinkState.speed)) {
+        shared_state_publish_link(linkState->up, linkState->speed);
+        prevLinkState = *linkState;
+    }
+
+    uint32_t ip = E.ethIntf->ip;
+    if (ip != prevIp) {
+        shared_state_publish_ip(ip);
+        prevIp = ip;
+    }
+}
+
 void init_ethernet() {
     // initialize EtherLib
     ethlib_init();
@@ -105,4 +129,8 @@ void init_ethernet() {
     MSG("\n---- \n");
     ethinf_print_info(E.ethIntf);
     MSG("---- \n\n");
+
+    // start monitoring the network state
+    checkNetStateTmr = osTimerNew(check_net_state, osTimerPeriodic, NULL, NULL);
+    osTimerStart(checkNetStateTmr, 1000);
 }
@@ -8,6 +8,7 @@
 #include "lwip/netif.h"
 #include "lwip/tcpip.h"
 #include "standard_output/standard_output.h"
+#include "shared_state.h"
 
 #include <stdbool.h>
 #include <stddef.h>
@@ -32,6 +33,8 @@ void check_dhcp_state(void *param) {
             MSG("DHCP configuration lost!\n");
         }
         prevDhcpOK = dhcpOK;
+
+        shared_state_publish_ip(dhcpOK ? ip4_addr_get_u32(netif_ip4_addr(&intf)) : 0);
     }
 }
 
@@ -39,11 +42,13 @@ void link_chg_cb(struct netif *netif) {
     bool ls = netif_is_link_up(netif);
     MSG("ETH LINK: %s%s", (ls ? (ANSI_COLOR_BGREEN "UP ") : (ANSI_COLOR_BRED "DOWN\n")), ANSI_COLOR_RESET);
 
+    LinkState *linkState = (LinkState *)netif->state;
     if (ls) {
-        LinkState *linkState = (LinkState *)netif->state;
         MSG("(%u Mbps, %s duplex)\n", linkState->speed, linkState->duplex ? "FULL" : "HALF");
     }
 
+    shared_state_publish_link(ls, linkState->speed);
+
     if (ls) {
         dhcp_start(netif);
     } else {
@@ -12,6 +12,7 @@
 #include "FreeRTOSConfig.h"
 
 #include "ICC/icc.h"
+#include "ICC/icc_bench.h"
 
 #include "etherlib/dynmem.h"
 #include "etherlib/etherlib.h"
@@ -51,8 +52,12 @@ void print_welcome_message() {
 
 void task_startup(void *arg) {
     // open ICC pipe
+    icc_bench_init();
     icc_open_pipe();
 
+    // batch console doorbells
+    icc_set_coalescing(ICC_COALESCE_ADAPTIVE);
+
     osDelay(2000);
 
     MSG("Booting up the M4 core!\n");
@@ -0,0 +1,62 @@
+#include "shared_state.h"
+
+#include <stdlib.h>
+
+#include <stm32h7xx_hal.h>
+
+#include "EthDrv/mac_drv.h"
+#include "ICC/icc.h"
+
+void shared_state_servo_reset() {
+    ICC_StateSnapshot *s = icc_state_write_begin();
+    s->servoState = ICC_SERVO_INACTIVE;
+    s->servoOutputPpb = 0.0f;
+    icc_state_write_end();
+}
+
+void shared_state_publish_servo(int32_t offsetNs, float tuningPpb) {
+    uint32_t addend = ETHHW_GetPTPAddend(ETH); // fetch before masking interrupts
+
+    ICC_StateSnapshot *s = icc_state_write_begin();
+    s->syncCnt++;
+    s->ptpOffsetNs = offsetNs;
+    s->ptpAddend = addend;
+    s->servoOutputPpb = tuningPpb;
+    s->servoState = (labs(offsetNs) < ICC_SERVO_LOCK_THRESHOLD_NS) ? ICC_SERVO_LOCKED : ICC_SERVO_TRACKING;
+    icc_state_write_end();
+}
+
+void shared_state_push_sync(int32_t offsetNs, float tuningPpb, const PtpServoAuxInput *pAux) {
+    // fill the record in place, no formatting
+    ICC_TsRecord *rec = icc_ts_begin();
+    if (rec == NULL) {
+        return;
+    }
+
+    const TimestampI *t = pAux->scd.t;
+    for (uint8_t i = 0; i < 4; i++) {
+        rec->t[i].sec = (uint32_t)t[i].sec;
+        rec->t[i].nanosec = (uint32_t)t[i].nanosec;
+    }
+
+    rec->reserved[0] = 0;
+    rec->reserved[1] = 0;
+    rec->offsetNs = offsetNs;
+    rec->servoOutputPpb = tuningPpb;
+    rec->addend = ETHHW_GetPTPAddend(ETH);
+
+    icc_ts_commit(rec);
+}
+
+void shared_state_publish_link(bool up, uint16_t speed) {
+    ICC_StateSnapshot *s = icc_state_write_begin();
+    s->linkUp = up;
+    s->linkSpeed = up ? speed : 0;
+    icc_state_write_end();
+}
+
+void shared_state_publish_ip(uint32_t ipAddr) {
+    ICC_StateSnapshot *s = icc_state_write_begin();
+    s->ipAddr = ipAddr;
+    icc_state_write_end();
+}
@@ -0,0 +1,42 @@
+#ifndef SRC_SHARED_STATE
+#define SRC_SHARED_STATE
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <flexptp/servo/pid_controller.h>
+
+/**
+ * Publish a servo reset.
+*/
+void shared_state_servo_reset();
+
+/**
+ * Publish the outcome of a servo run. Called from the flexPTP task after every sync cycle.
+ * @param offsetNs master-slave time difference fed into the servo [ns]
+ * @param tuningPpb servo output [ppb]
+*/
+void shared_state_publish_servo(int32_t offsetNs, float tuningPpb);
+
+/**
+ * Push a sync cycle record to the CM7 core's timestamp stream. Called from the flexPTP task after every servo run.
+ * @param offsetNs master-slave time difference fed into the servo [ns]
+ * @param tuningPpb servo output [ppb]
+ * @param pAux auxiliary servo input carrying the sync cycle timestamps
+*/
+void shared_state_push_sync(int32_t offsetNs, float tuningPpb, const PtpServoAuxInput *pAux);
+
+/**
+ * Publish Ethernet link state.
+ * @param up link is up
+ * @param speed link speed [Mbps]
+*/
+void shared_state_publish_link(bool up, uint16_t speed);
+
+/**
+ * Publish the IP-address.
+ * @param ipAddr IPv4 address as stored by the network stack, 0 if none
+*/
+void shared_state_publish_ip(uint32_t ipAddr);
+
+#endif /* SRC_SHARED_STATE */
@@ -1,26 +1,137 @@
 #include "standard_output.h"
 
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 
+#include <stm32h7xx_hal.h>
+
+#include <cmsis_os2.h>
+
 #include <embfmt/embformat.h>
 //#include <flatUSB/class/cdc.h>
 
 #include <ICC/icc.h>
 
-void icc_write(char * str, uint16_t len) {
-    ICCQueue * q = icc_get_outbound_pipe();
-    for (uint16_t i = 0; i < len; i++) {
-        if (!iccq_push(q, str + i)) {
+static char last_char = '\n';
+
+// The console channel is a single-producer queue. Tasks take turns through a mutex,
+// interrupts only write the queue while no task owns it, otherwise their output is
+// held back (or dropped if the hold buffer is full) until the owner releases the console.
+static osMutexId_t consoleMtx = NULL;
+static volatile bool consoleBusy = false; // a task is writing the console channel
+
+#define STDIO_OUTPUT_ISR_HOLD_LEN (256)
+static char isrHold[STDIO_OUTPUT_ISR_HOLD_LEN]; // interrupt output waiting for the console owner
+static uint32_t isrHoldLen = 0;
+static volatile uint32_t isrHoldDropped = 0; // bytes not fitting into the hold buffer
+
+#define STDIO_OUTPUT_ISR_LINE_LEN (128) // longest line formatted in interrupt context
+
+#define STDIO_OUTPUT_DROP_NOTE_LEN (32)
+static uint32_t reportedDrops = 0; // dropped bytes already reported on the console
+
+// report bytes lost since the last report in-band (console owner only)
+static void report_drops() {
+    uint32_t dropped = icc_get_flow_stats(ICC_CH_CONSOLE)->dropped + isrHoldDropped - reportedDrops;
+    if (dropped == 0) {
+        return;
+    }
+
+    char note[STDIO_OUTPUT_DROP_NOTE_LEN];
+    uint32_t len = embfmt(note, sizeof(note), "\r\n[%u bytes dropped]\r\n", dropped);
+    ICCQueue *q = icc_get_channel(ICC_CH_CONSOLE);
+    if (iccq_free(q) >= len) { // all or nothing, try again next time if it doesn't fit
+        iccq_push_n(q, note, len);
+        reportedDrops += dropped;
+        last_char = '\n';
+    }
+}
+
+#define STDIO_OUTPUT_LINEBUF_LEN (2048)
+static char lineBuf[STDIO_OUTPUT_LINEBUF_LEN + 1]; // owned by the task owning the console
+
+// take the console in task context, returns whether the mutex got locked
+static bool console_acquire() {
+    bool locked = false;
+    if (osKernelGetState() == osKernelRunning) {
+        if (consoleMtx == NULL) {
+            int32_t lock = osKernelLock();
+            if (consoleMtx == NULL) {
+                consoleMtx = osMutexNew(NULL);
+            }
+            osKernelRestoreLock(lock);
+        }
+        locked = (consoleMtx != NULL) && (osMutexAcquire(consoleMtx, osWaitForever) == osOK);
+    }
+    consoleBusy = true;
+    return locked;
+}
+
+// pass the interrupt output held back in the meantime, then give the console up
+static void console_release(bool locked) {
+    while (true) {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        uint32_t len = isrHoldLen;
+        if (len == 0) {
+            consoleBusy = false;
+            __set_PRIMASK(primask);
             break;
         }
+        memcpy(lineBuf, isrHold, len);
+        isrHoldLen = 0;
+        __set_PRIMASK(primask);
+
+        icc_write_channel(ICC_CH_CONSOLE, lineBuf, len, ICC_WRITE_NONBLOCKING);
+        last_char = lineBuf[len - 1];
+    }
+
+    if (locked) {
+        osMutexRelease(consoleMtx);
     }
-    icc_notify();
 }
 
-#define STDIO_OUTPUT_LINEBUF_LEN (2048)
-static char lineBuf[STDIO_OUTPUT_LINEBUF_LEN + 1];
+// write or hold back interrupt output, never blocks (call with interrupts disabled)
+static void console_put_isr(const char *data, uint32_t len) {
+    if (len == 0) {
+        return;
+    }
+
+    if (!consoleBusy) {
+        report_drops();
+        icc_write_channel(ICC_CH_CONSOLE, data, len, ICC_WRITE_NONBLOCKING);
+        last_char = data[len - 1];
+    } else {
+        uint32_t n = STDIO_OUTPUT_ISR_HOLD_LEN - isrHoldLen;
+        n = (len < n) ? len : n;
+        memcpy(isrHold + isrHoldLen, data, n);
+        isrHoldLen += n;
+        isrHoldDropped += len - n;
+    }
+}
+
+// blocks in task context until the data fits (or times out), MUST be called by the console owner
+static void console_write(const void *data, uint16_t len) {
+    report_drops();
+    icc_write_channel(ICC_CH_CONSOLE, data, len, ICC_WRITE_BLOCKING);
+}
+
+// blocks in task context until the data fits (or times out), drops data in interrupt context
+void icc_write(const void *data, uint16_t len) {
+    if (__get_IPSR() != 0) {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        console_put_isr((const char *)data, len);
+        __set_PRIMASK(primask);
+        return;
+    }
+
+    bool locked = console_acquire();
+    console_write(data, len);
+    console_release(locked);
+}
 
 static uint32_t insert_carriage_return(char *str, uint32_t maxLen) {
     uint32_t len = strlen(str);
@@ -40,25 +151,124 @@ static uint32_t insert_carriage_return(char *str, uint32_t maxLen) {
 }
 
 static const char core_prefix[] = "[" ANSI_COLOR_YELLOW "M4" ANSI_COLOR_RESET "] ";
-static char last_char = '\n';
+
+// size of the block reserved in the outbound pipe for formatting a line in place
+#define STDIO_OUTPUT_RESERVE_LEN (256)
+
+// insert \r before each lone \n in place, walking backwards (str must have room for nInsert more characters)
+static void expand_line_endings(char *str, uint32_t len, uint32_t nInsert) {
+    char *src = str + len;
+    char *dst = src + nInsert;
+    while (src > str && dst > src) {
+        char c = *(--src);
+        *(--dst) = c;
+        if ((c == '\n') && ((src == str) || (*(src - 1) != '\r'))) {
+            *(--dst) = '\r';
+        }
+    }
+}
+
+// count \n characters not preceded by a \r
+static uint32_t count_lone_newlines(const char *str, uint32_t len) {
+    uint32_t cnt = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        if ((str[i] == '\n') && ((i == 0) || (str[i - 1] != '\r'))) {
+            cnt++;
+        }
+    }
+    return cnt;
+}
+
+// format the line directly into the shared memory, return false if it did not fit
+static bool msg_in_place(const char *format, va_list vaArgP) {
+    char *span = (char *)icc_reserve(STDIO_OUTPUT_RESERVE_LEN);
+    if (span == NULL) {
+        return false;
+    }
+
+    // insert prefix if needed
+    uint32_t prefixLen = (last_char == '\n') ? (sizeof(core_prefix) - 1) : 0;
+    memcpy(span, core_prefix, prefixLen);
+
+    // format the line behind the prefix
+    char *line = span + prefixLen;
+    uint32_t maxLen = STDIO_OUTPUT_RESERVE_LEN - prefixLen - 1;
+    uint32_t lineLen = vembfmt(line, maxLen, format, vaArgP);
+    uint32_t nInsert = count_lone_newlines(line, lineLen);
+    if ((lineLen + 1 >= maxLen) || (lineLen + nInsert > maxLen)) { // possibly truncated or no room for the carriage returns
+        icc_commit(0);
+        return false;
+    }
+
+    // insert carriage returns and pass the line to the other core
+    expand_line_endings(line, lineLen, nInsert);
+    lineLen += nInsert;
+    if (lineLen > 0) {
+        last_char = line[lineLen - 1];
+        icc_commit(prefixLen + lineLen);
+    } else {
+        icc_commit(0);
+    }
+
+    return true;
+}
+
+// format a short line on the stack and pass it down the non-blocking interrupt path
+static void msg_isr(const char *format, va_list vaArgP) {
+    char line[STDIO_OUTPUT_ISR_LINE_LEN + 1];
+    vembfmt(line, STDIO_OUTPUT_ISR_LINE_LEN, format, vaArgP);
+    uint32_t lineLen = insert_carriage_return(line, STDIO_OUTPUT_ISR_LINE_LEN);
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if ((lineLen > 0) && (last_char == '\n')) {
+        console_put_isr(core_prefix, sizeof(core_prefix) - 1);
+    }
+    console_put_isr(line, lineLen);
+    __set_PRIMASK(primask);
+}
 
 void MSG(const char *format, ...) {
-    va_list vaArgP;
+    va_list vaArgP, vaArgPCopy;
     va_start(vaArgP, format);
+
+    // interrupts must not touch the pipe nor the line buffer
+    if (__get_IPSR() != 0) {
+        msg_isr(format, vaArgP);
+        va_end(vaArgP);
+        return;
+    }
+
+    bool locked = console_acquire();
+    report_drops();
+
+    // attempt to format right into the pipe
+    va_copy(vaArgPCopy, vaArgP);
+    bool done = msg_in_place(format, vaArgPCopy);
+    va_end(vaArgPCopy);
+    if (done) {
+        va_end(vaArgP);
+        console_release(locked);
+        return;
+    }
+
+    // long line or congested pipe: format into the line buffer
     uint32_t lineLen = vembfmt(lineBuf, STDIO_OUTPUT_LINEBUF_LEN, format, vaArgP);
     va_end(vaArgP);
     lineLen = insert_carriage_return(lineBuf, STDIO_OUTPUT_LINEBUF_LEN); // insert carriage returns
     if (lineLen > 0) {
         if (last_char == '\n') {
-            icc_write(core_prefix, sizeof(core_prefix));
+            console_write(core_prefix, sizeof(core_prefix) - 1);
         }
-        icc_write(lineBuf, lineLen);
+        console_write(lineBuf, lineLen);
         last_char = lineBuf[lineLen - 1];
     }
+    console_release(locked);
 }
 
 void MSGchar(int c) {
-    icc_write(&c, 1);
+    char ch = (char)c;
+    icc_write(&ch, 1);
 }
 
 void MSGraw(const char *str) {
@@ -8,12 +8,15 @@
 #include <stm32h7xx_hal.h>
 
 #include <ICC/icc.h>
+#include <ICC/icc_bench.h>
 
 #include "FreeRTOSConfig.h"
 
 #include "standard_output/serial_io.h"
 #include "standard_output/standard_output.h"
 
+#include <embfmt/embformat.h>
+
 #include <cmsis_os2.h>
 
 #define TARGET_SYSCLK_MHZ (configCPU_CLOCK_HZ / 1000000)
@@ -101,26 +104,44 @@ if (HSE_VALUE == 25000000) {
     HAL_RCCEx_PeriphCLKConfig(&perClk);
 }
 
-void icc_recv_cb() {
-    ICCQueue *q = icc_get_inbound_pipe();
-    uint16_t avail = iccq_avail(q);
-    if (avail > 0) {
-        // MSGraw("[" ANSI_COLOR_YELLOW "M4" ANSI_COLOR_RESET "] ");
-        for (uint16_t i = 0; i < avail; i++) {
-            char c;
-            iccq_top(q, &c);
-            iccq_pop(q);
-            MSGchar(c);
-        }
+static void console_recv_cb(ICC_ChannelId ch, ICCQueue *q) {
+    const void *p;
+    uint32_t len;
+    // forward contiguous blocks (at most two if the content wraps around)
+    while ((len = iccq_peek_contig(q, &p)) > 0) {
+        serial_io_write((const char *)p, len);
+        iccq_pop_n(q, NULL, len);
     }
 }
 
-void serial_io_rx_callback(const uint8_t *data, uint32_t size) {
-    ICCQueue *q = icc_get_outbound_pipe();
-    for (uint16_t i = 0; i < size; i++) {
-        iccq_push(q, data + i);
+static void blob_sink(const ICC_BlobChunk *chunk) {
+    char frame[64];
+    uint32_t len;
+
+    // the UART stream is shared with the console, frame the raw content
+    if (chunk->flags & ICC_BLOB_FIRST) {
+        len = embfmt(frame, sizeof(frame), "\r\n<<<BLOB %u TAG %u>>>\r\n", chunk->blobId, chunk->tag);
+        serial_io_write_blocking(frame, len);
+    }
+
+    serial_io_write_blocking((const char *)chunk->data, chunk->len); // paced by the UART, the sender waits for the window meanwhile
+
+    if (chunk->flags & ICC_BLOB_LAST) {
+        len = embfmt(frame, sizeof(frame), "\r\n<<<END %u: %u bytes%s>>>\r\n", chunk->blobId, chunk->offset + chunk->len,
+                     (chunk->flags & ICC_BLOB_ABORTED) ? ", ABORTED" : "");
+        serial_io_write_blocking(frame, len);
     }
-    icc_notify();
+}
+
+static void ts_sink(const ICC_TsRecord *rec) {
+    // export as CSV: seq, t1..t4, offset, servo output, addend, dropped
+    MSG("TS;%u;%u.%09u;%u.%09u;%u.%09u;%u.%09u;%d;%f;%u;%u\n", rec->seq,
+        rec->t[0].sec, rec->t[0].nanosec, rec->t[1].sec, rec->t[1].nanosec, rec->t[2].sec, rec->t[2].nanosec, rec->t[3].sec, rec->t[3].nanosec,
+        rec->offsetNs, rec->servoOutputPpb, rec->addend, rec->dropped);
+}
+
+void serial_io_rx_callback(const uint8_t *data, uint32_t size) {
+    icc_write_channel(ICC_CH_CLI_INPUT, data, size, ICC_WRITE_NONBLOCKING);
 }
 
 void task_startup(void *arg) {
@@ -136,6 +157,10 @@ void task_startup(void *arg) {
     icc_wake_up_M4();
 
     // open ICC pipe
+    icc_register_recv_cb(ICC_CH_CONSOLE, console_recv_cb);
+    icc_bench_init();
+    icc_blob_set_sink(blob_sink);
+    icc_ts_set_sink(ts_sink);
     icc_open_pipe();
 
     // -------------
@@ -176,6 +201,10 @@ int main(void) {
     // initialize ICC
     icc_init();
 
+    // enable caches, the ICC shared memory has been made non-cacheable by icc_init()
+    SCB_EnableICache();
+    SCB_EnableDCache();
+
     // boot up the M4 core
     // HAL_RCCEx_EnableBootCore(RCC_BOOT_C2);
 
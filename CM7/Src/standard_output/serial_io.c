@@ -112,16 +112,21 @@ void serial_io_write(const char *str, uint32_t len) {
     bfifo_push(&fifo, (const uint8_t *)str, len);
 }
 
+void serial_io_write_blocking(const char *str, uint32_t len) {
+    bfifo_push_all(&fifo, (const uint8_t *)str, len);
+}
+
 //  ----------
 
 #define SERIAL_IO_LINEBUF_LEN (256)
-static uint8_t lineBuf[SERIAL_IO_LINEBUF_LEN];
+static uint8_t lineBuf[SERIAL_IO_LINEBUF_LEN] __attribute__((aligned(32))); // aligned to cache lines
 
 static void serial_io_thread(void * arg) {
     while (true) {
         bfifo_wait_avail(&fifo);
         uint32_t size = bfifo_read(&fifo, lineBuf, SERIAL_IO_LINEBUF_LEN);
         bfifo_pop(&fifo, size, 0);
+        SCB_CleanDCache_by_Addr((uint32_t *)lineBuf, SERIAL_IO_LINEBUF_LEN); // write back before DMA reads it
         HAL_UART_Transmit_DMA(&uart, lineBuf, size);
         osEventFlagsWait(flags, SERIAL_IO_TX_CPLT_FLAG, 0, osWaitForever);
     }
@@ -7,6 +7,7 @@
 
 void serial_io_init();
 void serial_io_write(const char * str, uint32_t len);
+void serial_io_write_blocking(const char * str, uint32_t len); // waits for room, MUST be called from task context
 
 #endif /* STANDARD_OUTPUT_SERIAL_OUTPUT */
 
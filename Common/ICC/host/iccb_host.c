@@ -0,0 +1,126 @@
+/**
+ * Host build of the ICC benchmark (icc_bench.c).
+ * The main thread is the initiator task, two dispatcher threads stand in for the
+ * HSEM interrupts of the cores: a notification sets a flag and signals a condition
+ * variable, the woken dispatcher invokes the receive callback just like icc_dispatch() does.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "icc_bench.h"
+
+#define HOST_PING_QUEUE_LENGTH (256)  // same as ICC_CONTROL_QUEUE_LENGTH
+#define HOST_PONG_QUEUE_LENGTH (256)
+#define HOST_BULK_QUEUE_LENGTH (4096) // same as ICC_BENCH_QUEUE_LENGTH
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t pending; // bit per queue, like the HSEM masked interrupt status
+    bool stop;
+} Doorbell;
+
+static uint8_t pingMem[HOST_PING_QUEUE_LENGTH], pongMem[HOST_PONG_QUEUE_LENGTH], bulkMem[HOST_BULK_QUEUE_LENGTH];
+static ICCQueue ping, pong, bulk;
+static ICCB_Queues queues = {&ping, &pong, &bulk};
+
+static Doorbell initiatorDb = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, false};
+static Doorbell responderDb = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, false};
+
+#define HOST_QUEUE_BIT(q) (((q) == &ping) ? 0x01 : (((q) == &pong) ? 0x02 : 0x04))
+
+// ------
+
+static uint32_t host_get_cycles() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec); // 1 "cycle" = 1 ns
+}
+
+static void host_notify(ICCQueue *q) {
+    Doorbell *db = (q == &pong) ? &initiatorDb : &responderDb;
+    pthread_mutex_lock(&db->lock);
+    db->pending |= HOST_QUEUE_BIT(q);
+    pthread_cond_signal(&db->cond);
+    pthread_mutex_unlock(&db->lock);
+}
+
+static void host_yield() {
+    sched_yield(); // the host might have a single CPU
+}
+
+static void host_print(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+// no low-latency mode: the dispatcher threads run concurrently with the task, unlike interrupts
+static const ICCB_Port port = {host_get_cycles, 1000, host_notify, host_yield, host_print, NULL, NULL};
+
+// ------
+
+static void *dispatcher(void *arg) {
+    Doorbell *db = (Doorbell *)arg;
+    while (true) {
+        pthread_mutex_lock(&db->lock);
+        while ((db->pending == 0) && (!db->stop)) {
+            pthread_cond_wait(&db->cond, &db->lock);
+        }
+        uint32_t pending = db->pending;
+        bool stop = db->stop;
+        db->pending = 0;
+        pthread_mutex_unlock(&db->lock);
+
+        if (stop) {
+            break;
+        }
+
+        // serve the notified queues
+        if (db == &initiatorDb) {
+            iccb_initiator_recv(&pong);
+        } else {
+            if (pending & HOST_QUEUE_BIT(&ping)) {
+                iccb_responder_recv(&ping);
+            }
+            if (pending & HOST_QUEUE_BIT(&bulk)) {
+                iccb_responder_recv(&bulk);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void stop_dispatcher(Doorbell *db, pthread_t th) {
+    pthread_mutex_lock(&db->lock);
+    db->stop = true;
+    pthread_cond_signal(&db->cond);
+    pthread_mutex_unlock(&db->lock);
+    pthread_join(th, NULL);
+}
+
+int main() {
+    iccq_create(&ping, pingMem, HOST_PING_QUEUE_LENGTH, 1);
+    iccq_create(&pong, pongMem, HOST_PONG_QUEUE_LENGTH, 1);
+    iccq_create(&bulk, bulkMem, HOST_BULK_QUEUE_LENGTH, 1);
+    iccb_init(&port, &queues);
+
+    pthread_t initiatorTh, responderTh;
+    pthread_create(&initiatorTh, NULL, dispatcher, &initiatorDb);
+    pthread_create(&responderTh, NULL, dispatcher, &responderDb);
+
+    bool ok = iccb_run();
+
+    stop_dispatcher(&initiatorDb, initiatorTh);
+    stop_dispatcher(&responderDb, responderTh);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+/**
+ * Host benchmark comparing the byte-by-byte ICC queue access pattern
+ * (former iccq_push()/iccq_top()/iccq_pop() loops) with the bulk SPSC operations
+ * and the zero-copy reserve/commit path.
+ * A producer and a consumer thread stand in for the two cores.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "icc_queue.h"
+
+#define BENCH_QUEUE_LENGTH (4096)           // same as ICC_QUEUE_LENGTH
+#define BENCH_TOTAL_BYTES (16 * 1024 * 1024) // bytes transferred by each run
+#define BENCH_CHUNK_SIZE (80)               // typical log line length
+
+// ------ Legacy queue (modulo indexing, one element per call) ------
+
+typedef struct {
+    volatile uint32_t writeIdx;
+    volatile uint32_t readIdx;
+    uint32_t length;
+    uint32_t elemSize;
+    volatile uint8_t *elements;
+} LegacyQueue;
+
+#define MQ_NEXT(size, current) (((current) + 1) % (size))
+
+static uint32_t legacy_avail(const LegacyQueue *q) {
+    uint32_t w = q->writeIdx, r = q->readIdx; // the original read writeIdx twice, that's racy across threads
+    return ((w < r) ? (w + q->length) : w) - r;
+}
+
+static bool legacy_push(LegacyQueue *q, const void *src) {
+    if (MQ_NEXT(q->length, q->writeIdx) == q->readIdx) {
+        return false;
+    }
+    memcpy((uint8_t *)q->elements + q->writeIdx * q->elemSize, src, q->elemSize);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // the original had none, needed to run on the host at all
+    q->writeIdx = MQ_NEXT(q->length, q->writeIdx);
+    return true;
+}
+
+static void legacy_top(LegacyQueue *q, void *dest) {
+    memcpy(dest, (uint8_t *)q->elements + q->readIdx, q->elemSize);
+}
+
+static void legacy_pop(LegacyQueue *q) {
+    if (legacy_avail(q) > 0) {
+        q->readIdx = MQ_NEXT(q->length, q->readIdx);
+    }
+}
+
+// ------ Benchmark ------
+
+typedef enum {
+    BENCH_LEGACY,
+    BENCH_BULK,
+    BENCH_RESERVE
+} BenchMode;
+
+typedef struct {
+    BenchMode mode;
+    LegacyQueue lq;
+    ICCQueue q;
+    uint64_t checksum_in, checksum_out;
+} BenchCtx;
+
+static uint8_t legacyMem[BENCH_QUEUE_LENGTH];
+static uint8_t bulkMem[BENCH_QUEUE_LENGTH];
+
+static void *producer(void *arg) {
+    BenchCtx *ctx = (BenchCtx *)arg;
+    uint8_t chunk[BENCH_CHUNK_SIZE];
+    uint64_t sent = 0;
+    uint8_t seq = 0;
+
+    while (sent < BENCH_TOTAL_BYTES) {
+        uint32_t chunkSize = (BENCH_TOTAL_BYTES - sent < BENCH_CHUNK_SIZE) ? (BENCH_TOTAL_BYTES - sent) : BENCH_CHUNK_SIZE;
+
+        // generate the line right into the queue
+        if (ctx->mode == BENCH_RESERVE) {
+            uint8_t *span;
+            while ((span = iccq_reserve(&ctx->q, chunkSize)) == NULL) {
+                sched_yield();
+            }
+            for (uint32_t i = 0; i < chunkSize; i++) {
+                span[i] = seq++;
+                ctx->checksum_in += span[i];
+            }
+            iccq_commit(&ctx->q, chunkSize);
+            sent += chunkSize;
+            continue;
+        }
+
+        for (uint32_t i = 0; i < chunkSize; i++) {
+            chunk[i] = seq++;
+            ctx->checksum_in += chunk[i];
+        }
+
+        uint32_t done = 0;
+        while (done < chunkSize) {
+            uint32_t n = 0;
+            if (ctx->mode == BENCH_LEGACY) {
+                n = legacy_push(&ctx->lq, chunk + done) ? 1 : 0;
+            } else {
+                n = iccq_push_n(&ctx->q, chunk + done, chunkSize - done);
+            }
+
+            if (n == 0) { // queue full, let the consumer run (host might have a single CPU)
+                sched_yield();
+            }
+            done += n;
+        }
+        sent += chunkSize;
+    }
+
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    BenchCtx *ctx = (BenchCtx *)arg;
+    uint64_t received = 0;
+    uint8_t expected = 0;
+
+    while (received < BENCH_TOTAL_BYTES) {
+        if (ctx->mode == BENCH_LEGACY) {
+            uint32_t avail = legacy_avail(&ctx->lq);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            for (uint32_t i = 0; i < avail; i++) {
+                uint8_t c;
+                legacy_top(&ctx->lq, &c);
+                legacy_pop(&ctx->lq);
+                ctx->checksum_out += c;
+                if (c != expected++) {
+                    fprintf(stderr, "legacy: sequence error at %lu\n", (unsigned long)received);
+                    exit(1);
+                }
+                received++;
+            }
+        } else {
+            const void *p;
+            uint32_t len;
+            while ((len = iccq_peek_contig(&ctx->q, &p)) > 0) {
+                const uint8_t *b = (const uint8_t *)p;
+                for (uint32_t i = 0; i < len; i++) {
+                    ctx->checksum_out += b[i];
+                    if (b[i] != expected++) {
+                        fprintf(stderr, "bulk: sequence error at %lu\n", (unsigned long)(received + i));
+                        exit(1);
+                    }
+                }
+                iccq_pop_n(&ctx->q, NULL, len);
+                received += len;
+            }
+        }
+
+        sched_yield(); // queue drained, let the producer run
+    }
+
+    return NULL;
+}
+
+static double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1E-09;
+}
+
+static double run(BenchMode mode) {
+    static BenchCtx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.mode = mode;
+
+    ctx.lq.elements = legacyMem;
+    ctx.lq.length = BENCH_QUEUE_LENGTH;
+    ctx.lq.elemSize = 1;
+    iccq_create(&ctx.q, bulkMem, BENCH_QUEUE_LENGTH, 1);
+
+    pthread_t prod, cons;
+    double start = now_s();
+    pthread_create(&cons, NULL, consumer, &ctx);
+    pthread_create(&prod, NULL, producer, &ctx);
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+    double elapsed = now_s() - start;
+
+    if (ctx.checksum_in != ctx.checksum_out) {
+        fprintf(stderr, "checksum mismatch!\n");
+        exit(1);
+    }
+
+    return BENCH_TOTAL_BYTES / elapsed;
+}
+
+int main() {
+    double legacy = run(BENCH_LEGACY);
+    double bulk = run(BENCH_BULK);
+    double reserve = run(BENCH_RESERVE);
+
+    printf("queue: %u bytes, chunk: %u bytes, transferred: %u bytes\n", BENCH_QUEUE_LENGTH, BENCH_CHUNK_SIZE, BENCH_TOTAL_BYTES);
+    printf("legacy (per-byte): %8.2f MB/s\n", legacy / 1E+06);
+    printf("bulk SPSC:         %8.2f MB/s\n", bulk / 1E+06);
+    printf("reserve/commit:    %8.2f MB/s\n", reserve / 1E+06);
+    printf("speedup:           %8.2fx (bulk), %.2fx (reserve/commit)\n", bulk / legacy, reserve / legacy);
+
+    return 0;
+}
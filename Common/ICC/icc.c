@@ -5,5 +5,366 @@
 
 #include <stm32h7xx_hal.h>
 
+#include <cmsis_os2.h>
+
+ICC_SharedData sharedData __attribute__((section(".icc_section")));
+
+// channel properties in ICC_CH_* order
+static const ICC_ChannelDesc channels[ICC_CH_COUNT] = {
+    {"control-M7", ICC_DIR_SEVENBOUND, 3, 8, 0, false, ICC_CONTROL_QUEUE_LENGTH},  // ICC_CH_CONTROL_M7
+    {"control-M4", ICC_DIR_FOURBOUND, 4, 9, 0, false, ICC_CONTROL_QUEUE_LENGTH},   // ICC_CH_CONTROL_M4
+    {"cli", ICC_DIR_FOURBOUND, 2, 7, 1, false, ICC_CLI_INPUT_QUEUE_LENGTH},        // ICC_CH_CLI_INPUT
+    {"console", ICC_DIR_SEVENBOUND, 1, 6, 2, true, ICC_CONSOLE_QUEUE_LENGTH},      // ICC_CH_CONSOLE
+    {"telemetry", ICC_DIR_SEVENBOUND, 5, 10, 3, true, ICC_TELEMETRY_QUEUE_LENGTH}, // ICC_CH_TELEMETRY
+    {"bench", ICC_DIR_SEVENBOUND, 11, 12, 4, false, ICC_BENCH_QUEUE_LENGTH},       // ICC_CH_BENCH
+};
+
+#ifdef CORE_CM7
+#define ICC_INBOUND_DIR (ICC_DIR_SEVENBOUND)
+#define ICC_OUTBOUND_DIR (ICC_DIR_FOURBOUND)
+#define ICC_DEFAULT_OUTBOUND_CH (ICC_CH_CLI_INPUT)
+#define ICC_DEFAULT_INBOUND_CH (ICC_CH_CONSOLE)
+#else
+#define ICC_INBOUND_DIR (ICC_DIR_FOURBOUND)
+#define ICC_OUTBOUND_DIR (ICC_DIR_SEVENBOUND)
+#define ICC_DEFAULT_OUTBOUND_CH (ICC_CH_CONSOLE)
+#define ICC_DEFAULT_INBOUND_CH (ICC_CH_CLI_INPUT)
+#endif
+
+static ICC_RecvCb recvCbs[ICC_CH_COUNT]; // dispatch table
+static uint8_t dispatchOrder[ICC_CH_COUNT]; // channel IDs sorted by priority
+static bool dispatchOrderValid = false;
+
+static ICC_CoalesceMode coalesceMode = ICC_COALESCE_OFF; // doorbell coalescing mode
+static osTimerId_t flushTmr = NULL;                       // flush timer of deferred doorbells
+static uint32_t lastRingTick[ICC_CH_COUNT];               // time of the last doorbell
+static uint32_t lastRingIdx[ICC_CH_COUNT];                // write index signalled by the last doorbell
+static ICC_DoorbellStats dbStats[ICC_CH_COUNT];           // doorbell statistics
+
+static osEventFlagsId_t spaceEvt = NULL;                  // free space signals, one flag per channel
+static ICC_FlowStats flowStats[ICC_CH_COUNT];             // flow control statistics
+
+// counters are bumped from tasks, interrupts and the flush timer alike
+#define ICC_STAT_INC(cnt) __atomic_fetch_add(&(cnt), 1, __ATOMIC_RELAXED)
+
+// -------
+
+const ICC_ChannelDesc * icc_get_channel_desc(ICC_ChannelId ch) {
+    return channels + ch;
+}
+
+ICCQueue * icc_get_channel(ICC_ChannelId ch) {
+    return &(sharedData.queues[ch]);
+}
+
+static void icc_ring_doorbell(ICC_ChannelId ch) {
+    // advance the signalled index and account the bytes in one step, a preempting ring must not count them twice
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t w = icc_get_channel(ch)->writeIdx;
+    dbStats[ch].rings++;
+    dbStats[ch].bytes += w - lastRingIdx[ch];
+    lastRingIdx[ch] = w;
+    lastRingTick[ch] = HAL_GetTick();
+    __set_PRIMASK(primask);
+
+    ICC_STAT_INC(sharedData.notifyStats[ch].sent);
+
+    uint8_t semId = channels[ch].semId;
+    if (HAL_HSEM_FastTake(semId) == HAL_OK) {
+        HAL_HSEM_Release(semId, 0);
+    }
+}
+
+// account a served notification (consumer side)
+static void icc_account_notify(ICC_ChannelId ch) {
+    ICC_NotifyStats *stats = &sharedData.notifyStats[ch];
+    uint32_t pending = iccq_avail(icc_get_channel(ch));
+    ICC_STAT_INC(stats->received);
+    if (pending > stats->maxBatch) {
+        stats->maxBatch = pending;
+    }
+}
+
+// ring deferred doorbells
+static void icc_flush_cb(void *arg) {
+    for (uint8_t ch = 0; ch < ICC_CH_COUNT; ch++) {
+        if ((channels[ch].dir == ICC_OUTBOUND_DIR) && (icc_get_channel(ch)->writeIdx != lastRingIdx[ch])) {
+            icc_ring_doorbell(ch);
+        }
+    }
+}
+
+// signal a consumer waiting in icc_wait_sev() through the event line, skipping the doorbell
+static bool icc_try_sev(ICC_ChannelId ch) {
+    // pairs with the barrier in icc_wait_sev(): either the consumer sees the data or we see it has stopped waiting
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (sharedData.sevWaiting[ch] == 0) {
+        return false;
+    }
+
+    __DSB(); // the data must reach the shared memory before the event
+    __SEV();
+    return true;
+}
+
+void icc_notify_channel(ICC_ChannelId ch) {
+    ICC_STAT_INC(dbStats[ch].notifies);
+
+    if (icc_try_sev(ch)) {
+        ICC_STAT_INC(dbStats[ch].sevs);
+        ICC_STAT_INC(sharedData.notifyStats[ch].sent);
+        __atomic_store_n(&lastRingIdx[ch], icc_get_channel(ch)->writeIdx, __ATOMIC_RELAXED); // nothing left for the flush timer
+        return;
+    }
+
+    // ring immediately if coalescing is off, not allowed on this channel or the timer cannot be used (interrupt context)
+    if ((coalesceMode == ICC_COALESCE_OFF) || (!channels[ch].coalesce) || (__get_IPSR() != 0)) {
+        icc_ring_doorbell(ch);
+        return;
+    }
+
+    ICCQueue *q = icc_get_channel(ch);
+    uint32_t unsignalled = q->writeIdx - lastRingIdx[ch];                      // bytes written since the last doorbell
+    bool wasDrained = ((int32_t)(q->readIdx - lastRingIdx[ch])) >= 0;          // consumer has fetched everything signalled so far
+    bool quiet = (HAL_GetTick() - lastRingTick[ch]) >= ICC_COALESCE_FLUSH_MS; // no doorbell was rung recently
+
+    if ((unsignalled >= (q->length / ICC_COALESCE_THRESHOLD_DIV)) || // fill threshold reached
+        (wasDrained && quiet)) {                                     // empty -> non-empty transition after a quiet period
+        icc_ring_doorbell(ch);
+    } else if (unsignalled > 0) { // defer the doorbell
+        if (!osTimerIsRunning(flushTmr)) {
+            osTimerStart(flushTmr, ICC_COALESCE_FLUSH_MS);
+        }
+    }
+}
+
+void icc_init_flow_control() {
+    if (spaceEvt == NULL) {
+        spaceEvt = osEventFlagsNew(NULL);
+    }
+}
+
+// signal free space to the producer if it's waiting for it (consumer side)
+static void icc_signal_space(ICC_ChannelId ch) {
+    // pairs with the barrier in icc_wait_for_space(): either the producer sees the freed space or we see its request
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint32_t wanted = sharedData.spaceWanted[ch];
+    if ((wanted > 0) && (iccq_free(icc_get_channel(ch)) >= wanted)) {
+        sharedData.spaceWanted[ch] = 0;
+        uint8_t semId = channels[ch].spaceSemId;
+        if (HAL_HSEM_FastTake(semId) == HAL_OK) {
+            HAL_HSEM_Release(semId, 0);
+        }
+    }
+}
+
+// wait until at least 'wanted' bytes get freed (producer side)
+static bool icc_wait_for_space(ICC_ChannelId ch, uint32_t wanted) {
+    ICCQueue *q = icc_get_channel(ch);
+    uint32_t flag = 1UL << ch;
+
+    // make sure the consumer knows about everything written so far
+    if (q->writeIdx != lastRingIdx[ch]) {
+        icc_ring_doorbell(ch);
+    }
+
+    // post the request, then check again to not miss a signal sent in the meantime
+    osEventFlagsClear(spaceEvt, flag);
+    sharedData.spaceWanted[ch] = wanted;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (iccq_free(q) >= wanted) {
+        sharedData.spaceWanted[ch] = 0;
+        return true;
+    }
+
+    ICC_STAT_INC(flowStats[ch].waits);
+    uint32_t flags = osEventFlagsWait(spaceEvt, flag, osFlagsWaitAny, ICC_WRITE_TIMEOUT_MS);
+    bool ok = ((flags & osFlagsError) == 0) && (flags & flag);
+    sharedData.spaceWanted[ch] = 0;
+    if (!ok) {
+        ICC_STAT_INC(flowStats[ch].timeouts);
+    }
+    return ok;
+}
+
+uint32_t icc_write_channel(ICC_ChannelId ch, const void *data, uint32_t len, ICC_WriteMode mode) {
+    ICCQueue *q = icc_get_channel(ch);
+    const uint8_t *src = (const uint8_t *)data;
+
+    // cannot block in interrupt context or before flow control is initialized
+    if ((__get_IPSR() != 0) || (spaceEvt == NULL)) {
+        mode = ICC_WRITE_NONBLOCKING;
+    }
+
+    uint32_t written = iccq_push_n(q, src, len);
+    while ((written < len) && (mode == ICC_WRITE_BLOCKING)) {
+        // wait for room for the rest, but no more than half of the queue to keep the consumer going
+        uint32_t wanted = len - written;
+        if (wanted > (q->length / 2)) {
+            wanted = q->length / 2;
+        }
+        if (!icc_wait_for_space(ch, wanted)) {
+            break;
+        }
+        written += iccq_push_n(q, src + written, len - written);
+    }
+
+    if (written < len) {
+        __atomic_fetch_add(&flowStats[ch].dropped, len - written, __ATOMIC_RELAXED);
+    }
+    if (written > 0) {
+        icc_notify_channel(ch);
+    }
+
+    return written;
+}
+
+bool icc_wait_sev(ICC_ChannelId ch, uint32_t timeoutUs) {
+    ICCQueue *q = icc_get_channel(ch);
+    uint32_t timeoutCycles = timeoutUs * (SystemCoreClock / 1000000);
+    uint32_t start = DWT->CYCCNT;
+
+    // announce the wait, then check the queue to not miss data committed in the meantime
+    sharedData.sevWaiting[ch] = 1;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    bool avail;
+    while ((!(avail = (iccq_avail(q) > 0))) && ((DWT->CYCCNT - start) < timeoutCycles)) {
+        __WFE(); // woken by the peer's SEV, an interrupt or a stale event
+    }
+    sharedData.sevWaiting[ch] = 0;
+
+    // a producer that still saw the flag has sent a SEV only, catch its data
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    avail = avail || (iccq_avail(q) > 0);
+    if (avail) {
+        icc_account_notify(ch);
+    }
+    return avail;
+}
+
+void icc_start_cycle_counter() {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+#ifdef CORE_CM7
+    DWT->LAR = 0xC5ACCE55; // unlock DWT access
+#endif
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+const ICC_NotifyStats * icc_get_notify_stats(ICC_ChannelId ch) {
+    return sharedData.notifyStats + ch;
+}
+
+const ICC_FlowStats * icc_get_flow_stats(ICC_ChannelId ch) {
+    return flowStats + ch;
+}
+
+void icc_set_coalescing(ICC_CoalesceMode mode) {
+    if ((mode != ICC_COALESCE_OFF) && (flushTmr == NULL)) {
+        flushTmr = osTimerNew(icc_flush_cb, osTimerOnce, NULL, NULL);
+        if (flushTmr == NULL) {
+            return; // cannot defer doorbells without the timer
+        }
+    }
+
+    coalesceMode = mode;
+
+    if (mode == ICC_COALESCE_OFF) {
+        icc_flush_cb(NULL); // signal data left behind
+    }
+}
+
+ICC_CoalesceMode icc_get_coalescing() {
+    return coalesceMode;
+}
+
+const ICC_DoorbellStats * icc_get_doorbell_stats(ICC_ChannelId ch) {
+    return dbStats + ch;
+}
+
+static void icc_sort_dispatch_order() {
+    // insertion sort by priority, keeps channel ID order for equal priorities
+    for (uint8_t i = 0; i < ICC_CH_COUNT; i++) {
+        uint8_t k = i;
+        while ((k > 0) && (channels[dispatchOrder[k - 1]].prio > channels[i].prio)) {
+            dispatchOrder[k] = dispatchOrder[k - 1];
+            k--;
+        }
+        dispatchOrder[k] = i;
+    }
+    dispatchOrderValid = true;
+}
+
+void icc_register_recv_cb(ICC_ChannelId ch, ICC_RecvCb cb) {
+    if (!dispatchOrderValid) {
+        icc_sort_dispatch_order();
+    }
+    recvCbs[ch] = cb;
+}
+
+uint32_t icc_get_inbound_sem_mask() {
+    uint32_t mask = 0;
+    for (uint8_t ch = 0; ch < ICC_CH_COUNT; ch++) {
+        if (channels[ch].dir == ICC_INBOUND_DIR) {
+            mask |= __HAL_HSEM_SEMID_TO_MASK(channels[ch].semId);
+        } else {
+            mask |= __HAL_HSEM_SEMID_TO_MASK(channels[ch].spaceSemId);
+        }
+    }
+    return mask | icc_blob_get_sem_mask();
+}
+
+void icc_dispatch(uint32_t semMask) {
+    if (!dispatchOrderValid) {
+        icc_sort_dispatch_order();
+    }
+
+    // serve channels in priority order
+    for (uint8_t i = 0; i < ICC_CH_COUNT; i++) {
+        uint8_t ch = dispatchOrder[i];
+        if (channels[ch].dir == ICC_INBOUND_DIR) {
+            uint32_t chMask = __HAL_HSEM_SEMID_TO_MASK(channels[ch].semId);
+            if (semMask & chMask) {
+                icc_account_notify(ch);
+                if (recvCbs[ch] != NULL) {
+                    recvCbs[ch](ch, icc_get_channel(ch));
+                }
+                HAL_HSEM_ActivateNotification(chMask); // re-arm notification
+            }
+            icc_signal_space(ch); // the callback might have freed space a producer is waiting for
+        } else {
+            uint32_t spaceMask = __HAL_HSEM_SEMID_TO_MASK(channels[ch].spaceSemId);
+            if (semMask & spaceMask) {
+                if (spaceEvt != NULL) {
+                    osEventFlagsSet(spaceEvt, 1UL << ch); // wake up the blocked writer
+                }
+                HAL_HSEM_ActivateNotification(spaceMask);
+            }
+        }
+    }
+
+    icc_blob_dispatch(semMask);
+}
+
 // -------
 
+void icc_notify() {
+    icc_notify_channel(ICC_DEFAULT_OUTBOUND_CH);
+}
+
+ICCQueue * icc_get_outbound_pipe() {
+    return icc_get_channel(ICC_DEFAULT_OUTBOUND_CH);
+}
+
+ICCQueue * icc_get_inbound_pipe() {
+    return icc_get_channel(ICC_DEFAULT_INBOUND_CH);
+}
+
+void * icc_reserve(uint32_t len) {
+    return iccq_reserve(icc_get_outbound_pipe(), len);
+}
+
+void icc_commit(uint32_t n) {
+    iccq_commit(icc_get_outbound_pipe(), n);
+    icc_notify();
+}
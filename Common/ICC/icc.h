@@ -5,29 +5,131 @@
 #include <stdint.h>
 
 #include "icc_queue.h"
+#include "icc_state.h"
+#include "icc_blob.h"
+#include "icc_ts.h"
 
-#define ICC_QUEUE_LENGTH (4096)
+// ------ CHANNELS --------
 
-// typedef struct {
-//     uint8_t p[ICC_COPYBUF_LEN]; ///< Buffer area
-//     uint16_t n; ///< Size of stored content
-// } ICC_CopyBuf;
+/**
+ * ICC channels. Each channel is an independent ring in the shared memory
+ * with a dedicated hardware semaphore serving as its doorbell.
+ */
+typedef enum {
+    ICC_CH_CONTROL_M7,  ///< Control messages towards the CM7 core
+    ICC_CH_CONTROL_M4,  ///< Control messages towards the CM4 core
+    ICC_CH_CLI_INPUT,   ///< CLI keystrokes (CM7 -> CM4)
+    ICC_CH_CONSOLE,     ///< Console text (CM4 -> CM7)
+    ICC_CH_TELEMETRY,   ///< Timestamp record stream (CM4 -> CM7, see icc_ts.h)
+    ICC_CH_BENCH,       ///< Benchmark stream (CM4 -> CM7)
+    ICC_CH_COUNT        ///< Number of channels
+} ICC_ChannelId;
+
+typedef enum {
+    ICC_DIR_SEVENBOUND, ///< CM4 -> CM7
+    ICC_DIR_FOURBOUND   ///< CM7 -> CM4
+} ICC_Direction;
+
+/**
+ * Static channel properties.
+ */
+typedef struct {
+    const char *name;   ///< Channel name
+    uint8_t dir;        ///< Direction (ICC_Direction)
+    uint8_t semId;      ///< Hardware semaphore ID used as the doorbell
+    uint8_t spaceSemId; ///< Hardware semaphore ID signalling free space back to a blocked producer
+    uint8_t prio;       ///< Notification priority on the receiving core, lower value is dispatched earlier
+    uint8_t coalesce;   ///< Doorbell coalescing is allowed on this channel
+    uint32_t length;    ///< Queue length in bytes (power of two)
+} ICC_ChannelDesc;
 
+/**
+ * Doorbell coalescing modes.
+ */
+typedef enum {
+    ICC_COALESCE_OFF,     ///< Ring the doorbell on every notification
+    ICC_COALESCE_ADAPTIVE ///< Ring on empty->non-empty transition, fill threshold or flush timer expiry
+} ICC_CoalesceMode;
+
+#define ICC_COALESCE_FLUSH_MS (2)      // flush timer period and minimum gap between transition-triggered doorbells
+#define ICC_COALESCE_THRESHOLD_DIV (4) // fill threshold is queue length / ICC_COALESCE_THRESHOLD_DIV
+
+/**
+ * Doorbell statistics of an outbound channel.
+ */
+typedef struct {
+    uint32_t notifies; ///< Notification requests
+    uint32_t rings;    ///< Doorbells actually rung (interrupts raised on the other core)
+    uint32_t bytes;    ///< Bytes signalled by the doorbells
+    uint32_t sevs;     ///< Notifications delivered through the event line to a consumer in icc_wait_sev()
+} ICC_DoorbellStats;
+
+/**
+ * Notification statistics of a channel, kept in the shared memory, readable from both cores.
+ */
+typedef struct {
+    volatile uint32_t sent;     ///< Notifications sent by the producer (doorbells and SEVs)
+    volatile uint32_t received; ///< Notifications served by the consumer
+    volatile uint32_t maxBatch; ///< Maximum bytes pending when the consumer served a notification
+} ICC_NotifyStats;
+
+/**
+ * Write modes.
+ */
+typedef enum {
+    ICC_WRITE_BLOCKING,   ///< Wait for the consumer to free space (task context only, falls back to non-blocking elsewhere)
+    ICC_WRITE_NONBLOCKING ///< Push as much as fits, count the rest as dropped
+} ICC_WriteMode;
+
+#define ICC_SEV_SPIN_US (100) // suggested icc_wait_sev() timeout before falling back to the HSEM doorbell
+
+#define ICC_WRITE_TIMEOUT_MS (50) // maximum time a blocking write waits for free space before dropping the rest
+
+/**
+ * Flow control statistics of an outbound channel.
+ */
 typedef struct {
-    ICCQueue sevenBound, fourBound; ///< Copy buffers for each direction
-    uint8_t pSevenBound[ICC_QUEUE_LENGTH]; ///< Data area for the queues
-    uint8_t pFourBound[ICC_QUEUE_LENGTH]; 
+    uint32_t waits;    ///< Number of times a blocking write waited for free space
+    uint32_t timeouts; ///< Number of blocking writes timed out
+    uint32_t dropped;  ///< Bytes dropped
+} ICC_FlowStats;
+
+#define ICC_CONTROL_QUEUE_LENGTH (256) // queue lengths, MUST be powers of two
+#define ICC_CLI_INPUT_QUEUE_LENGTH (512)
+#define ICC_CONSOLE_QUEUE_LENGTH (8192)
+#define ICC_TELEMETRY_QUEUE_LENGTH (4096)
+#define ICC_BENCH_QUEUE_LENGTH (4096)
+
+// ICC_CH_* order, channel properties are listed in icc.c
+typedef struct {
+    ICCQueue queues[ICC_CH_COUNT];                      ///< Channel queues
+    ICC_SharedState state;                              ///< State snapshot published by the CM4 core
+    volatile uint32_t spaceWanted[ICC_CH_COUNT];        ///< Free space a blocked producer waits for (0: none)
+    volatile uint32_t sevWaiting[ICC_CH_COUNT];         ///< Consumer is waiting in icc_wait_sev(), signal it with SEV
+    ICC_NotifyStats notifyStats[ICC_CH_COUNT];          ///< Notification statistics (queue statistics are kept in the queues)
+    ICC_BlobWindow blobWindows[ICC_BLOB_WINDOW_CNT];    ///< Bulk transfer windows
+    uint8_t pControlM7[ICC_CONTROL_QUEUE_LENGTH];       ///< Data area for the queues
+    uint8_t pControlM4[ICC_CONTROL_QUEUE_LENGTH];
+    uint8_t pCliInput[ICC_CLI_INPUT_QUEUE_LENGTH];
+    uint8_t pConsole[ICC_CONSOLE_QUEUE_LENGTH];
+    uint8_t pTelemetry[ICC_TELEMETRY_QUEUE_LENGTH];
+    uint8_t pBench[ICC_BENCH_QUEUE_LENGTH];
 } ICC_SharedData;
 
 #define ICC_WAKEUP_SEMID (0) // semaphore ID for wakeing up the CM4 core from the CM7 core
 
-#define ICC_SEVENBOUND_SEMID (1) // semaphore IDs for communication between the cores
-#define ICC_FOURBOUND_SEMID (2)
+/**
+ * Channel receive callback, invoked from the HSEM interrupt of the receiving core.
+ * @param ch channel ID
+ * @param q the channel's queue
+ */
+typedef void (*ICC_RecvCb)(ICC_ChannelId ch, ICCQueue *q);
 
 // ------ CM7 ONLY --------
 
 /**
- * Initialize FIFOs.
+ * Initialize FIFOs and configure the MPU to keep the shared memory out of the D-cache.
+ * MUST be called before enabling the D-cache.
 */
 void icc_init();
 
@@ -46,12 +148,12 @@ void icc_wait_for_M7_bootup();
 // ------ IMPLEMENTED ON BOTH CORES --------
 
 /**
- * Open up the pipe between the two cores.
+ * Open up the inbound channels of this core.
 */
 void icc_open_pipe();
 
 /**
- * Notify the other core.
+ * Notify the other core on the default outbound pipe.
 */
 void icc_notify();
 
@@ -67,4 +169,126 @@ ICCQueue * icc_get_outbound_pipe();
 */
 ICCQueue * icc_get_inbound_pipe();
 
+/**
+ * Reserve a contiguous block in the outbound pipe.
+ * The caller may write (e.g. format text) directly into the shared memory.
+ * @param len number of bytes to reserve
+ * @return pointer to the reserved block OR NULL if the pipe has no room for it
+*/
+void * icc_reserve(uint32_t len);
+
+/**
+ * Commit the lastly reserved block and notify the other core.
+ * @param n number of bytes actually written into the block
+*/
+void icc_commit(uint32_t n);
+
+/**
+ * Get channel properties.
+ * @param ch channel ID
+ * @return pointer to the channel descriptor
+*/
+const ICC_ChannelDesc * icc_get_channel_desc(ICC_ChannelId ch);
+
+/**
+ * Get a channel's queue.
+ * @param ch channel ID
+ * @return pointer to the channel's queue
+*/
+ICCQueue * icc_get_channel(ICC_ChannelId ch);
+
+/**
+ * Notify the other core about new data on a channel.
+ * The doorbell might be deferred according to the coalescing mode.
+ * @param ch channel ID
+*/
+void icc_notify_channel(ICC_ChannelId ch);
+
+/**
+ * Wait for data on an inbound channel in low-latency mode: while waiting, the producer signals
+ * through the cross-core event line (SEV) instead of the HSEM doorbell, skipping the interrupt path.
+ * The core sleeps in WFE, so it is meant for a dedicated consumer task. A wake-up might be delayed
+ * by the next interrupt (e.g. the tick) if no event arrives. The caller consumes the data itself
+ * and MUST keep the channel's receive callback from doing the same.
+ * @param ch channel ID
+ * @param timeoutUs maximum time to wait [us], after that the HSEM doorbell is used again
+ * @return true if data is available
+*/
+bool icc_wait_sev(ICC_ChannelId ch, uint32_t timeoutUs);
+
+/**
+ * Start the DWT cycle counter used for timing.
+*/
+void icc_start_cycle_counter();
+
+/**
+ * Write data into an outbound channel and notify the other core.
+ * @param ch channel ID
+ * @param data pointer to the data
+ * @param len number of bytes to write
+ * @param mode write mode
+ * @return number of bytes written, the remainder is counted as dropped
+*/
+uint32_t icc_write_channel(ICC_ChannelId ch, const void *data, uint32_t len, ICC_WriteMode mode);
+
+/**
+ * Get notification statistics of a channel (any direction).
+ * @param ch channel ID
+ * @return pointer to the statistics
+*/
+const ICC_NotifyStats * icc_get_notify_stats(ICC_ChannelId ch);
+
+/**
+ * Get flow control statistics of an outbound channel.
+ * @param ch channel ID
+ * @return pointer to the statistics
+*/
+const ICC_FlowStats * icc_get_flow_stats(ICC_ChannelId ch);
+
+/**
+ * Initialize flow control, called by icc_open_pipe().
+*/
+void icc_init_flow_control();
+
+/**
+ * Set doorbell coalescing mode. MUST be called from task context.
+ * @param mode coalescing mode
+*/
+void icc_set_coalescing(ICC_CoalesceMode mode);
+
+/**
+ * Get doorbell coalescing mode.
+ * @return current coalescing mode
+*/
+ICC_CoalesceMode icc_get_coalescing();
+
+/**
+ * Get doorbell statistics of an outbound channel.
+ * @param ch channel ID
+ * @return pointer to the statistics
+*/
+const ICC_DoorbellStats * icc_get_doorbell_stats(ICC_ChannelId ch);
+
+/**
+ * Register a receive callback for an inbound channel.
+ * @param ch channel ID
+ * @param cb callback function (NULL to unregister)
+*/
+void icc_register_recv_cb(ICC_ChannelId ch, ICC_RecvCb cb);
+
+/**
+ * Get the mask of semaphores notifying this core: doorbells of the inbound channels,
+ * space signals of the outbound channels and blob transfer signals.
+ * @return semaphore mask
+*/
+uint32_t icc_get_inbound_sem_mask();
+
+/**
+ * Dispatch notifications to the registered callbacks in priority order,
+ * signal free space to blocked producers on both sides.
+ * Called from the HSEM interrupt, notifications get re-armed.
+ * @param semMask mask of the freed semaphores
+*/
+void icc_dispatch(uint32_t semMask);
+
 #endif /* ICC_ICC */
@@ -0,0 +1,354 @@
+#include "icc_bench.h"
+
+#include <string.h>
+
+typedef enum {
+    ICCB_MSG_PING, // latency probe
+    ICCB_MSG_PONG, // probe reply
+    ICCB_MSG_DATA, // throughput stream payload
+    ICCB_MSG_END,  // end of stream
+    ICCB_MSG_ACK,  // end of stream or mode switch acknowledgement
+    ICCB_MSG_MODE  // switch the responder's signalling mode
+} ICCB_MsgType;
+
+typedef struct {
+    uint16_t type; // message type (ICCB_MsgType)
+    uint16_t len;  // message length including the header
+    uint32_t seq;  // sequence number
+    uint32_t arg;  // PING, PONG: send timestamp, ACK: bytes received, MODE: low-latency mode
+} ICCB_MsgHeader;
+
+static const ICCB_Port *port = NULL;
+static const ICCB_Queues *queues = NULL;
+
+// initiator state, written by the receive callback
+static uint32_t replySeq;    // sequence number of the last reply
+static uint32_t replyCycles; // round-trip time of the last probe or stream length acknowledged
+static bool llInitiator;     // initiator is in low-latency mode, the task reads the replies
+
+// responder state
+static uint32_t rxBytes;          // bytes of the stream received so far
+static volatile bool llResponder; // responder is in low-latency mode, the 'ping' queue is served by iccb_responder_serve()
+static bool modePending;          // a mode switch has been requested
+static ICCB_MsgHeader modeMsg;    // the mode switch request
+
+// message sizes including the header, latency probes MUST fit into half of the 'ping' queue
+static const uint16_t latencySizes[] = {sizeof(ICCB_MsgHeader), 32, 128};
+static const uint16_t streamSizes[] = {16, 64, 256, 1024};
+
+#define ICCB_ARRAY_LEN(a) (sizeof(a) / sizeof((a)[0]))
+
+// -------
+
+static uint32_t iccb_cycles_to_ns(uint32_t cycles) {
+    return (uint32_t)(((uint64_t)cycles * 1000) / port->cyclesPerUs);
+}
+
+static uint32_t iccb_elapsed_us(uint32_t start) {
+    return (port->get_cycles() - start) / port->cyclesPerUs;
+}
+
+static void iccb_yield() {
+    if (port->yield != NULL) {
+        port->yield();
+    }
+}
+
+// send a message, wait for room at most timeoutUs
+static bool iccb_send(ICCQueue *q, uint16_t type, uint16_t len, uint32_t seq, uint32_t arg, uint32_t timeoutUs) {
+    uint32_t start = port->get_cycles();
+    uint8_t *p;
+    while ((p = (uint8_t *)iccq_reserve(q, len)) == NULL) {
+        if (iccb_elapsed_us(start) >= timeoutUs) {
+            return false;
+        }
+        iccb_yield();
+    }
+
+    ICCB_MsgHeader hdr = {type, len, seq, arg};
+    memcpy(p, &hdr, sizeof(ICCB_MsgHeader));
+    memset(p + sizeof(ICCB_MsgHeader), (uint8_t)seq, len - sizeof(ICCB_MsgHeader)); // dummy payload
+    iccq_commit(q, len);
+    port->notify(q);
+
+    return true;
+}
+
+// iterate over the messages of a queue until the handler returns false, messages never straddle the wrap-around
+static void iccb_process(ICCQueue *q, bool (*handler)(const ICCB_MsgHeader *hdr)) {
+    const void *p;
+    uint32_t len;
+    bool cont = true;
+    while (cont && ((len = iccq_peek_contig(q, &p)) >= sizeof(ICCB_MsgHeader))) {
+        const uint8_t *b = (const uint8_t *)p;
+        uint32_t done = 0;
+        while (cont && ((len - done) >= sizeof(ICCB_MsgHeader))) {
+            ICCB_MsgHeader hdr;
+            memcpy(&hdr, b + done, sizeof(ICCB_MsgHeader));
+            if ((hdr.len < sizeof(ICCB_MsgHeader)) || (hdr.len > (len - done))) { // corrupted stream, discard the block
+                done = len;
+                break;
+            }
+            cont = handler(&hdr);
+            done += hdr.len;
+        }
+        iccq_pop_n(q, NULL, done);
+    }
+}
+
+static bool iccb_initiator_handler(const ICCB_MsgHeader *hdr);
+
+// wait for the reply to the message with sequence number seq
+static bool iccb_wait_reply(uint32_t seq) {
+    uint32_t start = port->get_cycles();
+    while (__atomic_load_n(&replySeq, __ATOMIC_ACQUIRE) != seq) {
+        uint32_t elapsedUs = iccb_elapsed_us(start);
+        if (elapsedUs >= ICCB_TIMEOUT_US) {
+            return false;
+        }
+
+        if (llInitiator) { // read the replies in place of the receive callback
+            if (port->wait(queues->pong, ICCB_TIMEOUT_US - elapsedUs)) {
+                iccb_process(queues->pong, iccb_initiator_handler);
+            }
+        } else {
+            iccb_yield();
+        }
+    }
+    return true;
+}
+
+// -------
+
+static void iccb_hist_add(ICCB_Histogram *h, uint32_t ns) {
+    uint8_t bin = 0;
+    while (((ns >> (bin + 1)) > 0) && (bin < (ICCB_HIST_BINS - 1))) {
+        bin++;
+    }
+
+    h->bins[bin]++;
+    h->minNs = (h->cnt == 0 || ns < h->minNs) ? ns : h->minNs;
+    h->maxNs = (ns > h->maxNs) ? ns : h->maxNs;
+    h->sumNs += ns;
+    h->cnt++;
+}
+
+static void iccb_hist_print(const ICCB_Histogram *h) {
+    if (h->cnt == 0) {
+        port->print("  no samples, %u lost\n", h->lost);
+        return;
+    }
+
+    port->print("  min: %u ns, avg: %u ns, max: %u ns, lost: %u\n", h->minNs, (uint32_t)(h->sumNs / h->cnt), h->maxNs, h->lost);
+    for (uint8_t i = 0; i < ICCB_HIST_BINS; i++) {
+        if (h->bins[i] > 0) {
+            port->print("  [%8u, %8u) ns: %u\n", (i == 0) ? 0 : (uint32_t)(1UL << i), (uint32_t)(1UL << (i + 1)), h->bins[i]);
+        }
+    }
+}
+
+// -------
+
+static bool iccb_measure_latency(uint16_t size) {
+    static ICCB_Histogram h;
+    memset(&h, 0, sizeof(ICCB_Histogram));
+
+    for (uint32_t i = 0; i < ICCB_LATENCY_ROUNDS; i++) {
+        uint32_t seq = replySeq + 1;
+        if (!iccb_send(queues->ping, ICCB_MSG_PING, size, seq, port->get_cycles(), ICCB_TIMEOUT_US) || !iccb_wait_reply(seq)) {
+            h.lost++;
+            __atomic_store_n(&replySeq, seq, __ATOMIC_RELEASE); // skip a late reply
+            continue;
+        }
+        iccb_hist_add(&h, iccb_cycles_to_ns(replyCycles) / 2); // one-way latency
+    }
+
+    port->print(" %u-byte messages, %u rounds:\n", size, ICCB_LATENCY_ROUNDS);
+    iccb_hist_print(&h);
+
+    return h.lost == 0;
+}
+
+// switch both sides to low-latency or to interrupt driven mode
+static bool iccb_set_low_latency(bool en) {
+    uint32_t seq = replySeq + 1;
+    llInitiator = false; // the acknowledgement arrives through the receive callback
+    bool ok = iccb_send(queues->ping, ICCB_MSG_MODE, sizeof(ICCB_MsgHeader), seq, en, ICCB_TIMEOUT_US) && iccb_wait_reply(seq);
+    if (!ok) {
+        __atomic_store_n(&replySeq, seq, __ATOMIC_RELEASE);
+        return false;
+    }
+    llInitiator = en;
+    return true;
+}
+
+static bool iccb_measure_throughput(uint16_t size) {
+    uint32_t seq = replySeq + 1;
+    uint32_t sent = 0;
+    uint32_t start = port->get_cycles();
+
+    // stream the payload and close it with an end marker
+    bool ok = true;
+    while (ok && (sent < ICCB_THROUGHPUT_BYTES)) {
+        ok = iccb_send(queues->bulk, ICCB_MSG_DATA, size, seq, 0, ICCB_TIMEOUT_US);
+        sent += size;
+    }
+    ok = ok && iccb_send(queues->bulk, ICCB_MSG_END, sizeof(ICCB_MsgHeader), seq, 0, ICCB_TIMEOUT_US) && iccb_wait_reply(seq);
+    uint32_t elapsedUs = iccb_elapsed_us(start);
+
+    if (!ok) {
+        port->print(" %5u-byte messages: timed out\n", size);
+        __atomic_store_n(&replySeq, seq, __ATOMIC_RELEASE);
+        return false;
+    }
+
+    uint32_t received = replyCycles;
+    bool complete = received == (sent + sizeof(ICCB_MsgHeader));
+    uint32_t kBps = (elapsedUs > 0) ? (uint32_t)(((uint64_t)received * 1000) / elapsedUs) : 0;
+    port->print(" %5u-byte messages: %u bytes in %u us, %u kB/s (%u msg/s)%s\n", size, received, elapsedUs, kBps,
+                (elapsedUs > 0) ? (uint32_t)(((uint64_t)(received / size) * 1000000) / elapsedUs) : 0,
+                complete ? "" : ", BYTES MISSING!");
+
+    return complete;
+}
+
+static void iccb_measure_push_cost(uint16_t size) {
+    static uint8_t mem[4096];
+    static uint8_t src[1024];
+    ICCQueue q;
+    iccq_create(&q, mem, sizeof(mem), 1);
+
+    uint32_t cycles = 0;
+    for (uint32_t i = 0; i < ICCB_PUSH_ROUNDS; i++) {
+        uint32_t start = port->get_cycles();
+        iccq_push_n(&q, src, size);
+        cycles += port->get_cycles() - start;
+        iccq_pop_n(&q, NULL, size);
+    }
+
+    uint32_t perCall = cycles / ICCB_PUSH_ROUNDS;
+    uint32_t perByteX100 = (uint32_t)(((uint64_t)cycles * 100) / ((uint64_t)ICCB_PUSH_ROUNDS * size));
+    port->print(" %5u bytes: %u cycles/call, %u.%02u cycles/byte\n", size, perCall, perByteX100 / 100, perByteX100 % 100);
+}
+
+// -------
+
+void iccb_init(const ICCB_Port *p, const ICCB_Queues *qs) {
+    port = p;
+    queues = qs;
+    replySeq = 0;
+    llInitiator = false;
+    rxBytes = 0;
+    llResponder = false;
+    modePending = false;
+}
+
+bool iccb_run() {
+    bool ok = true;
+
+    port->print("ICC benchmark\n\nNotify-to-callback latency (round-trip / 2):\n");
+    for (uint8_t i = 0; i < ICCB_ARRAY_LEN(latencySizes); i++) {
+        ok &= iccb_measure_latency(latencySizes[i]);
+    }
+
+    if (port->wait != NULL) {
+        port->print("\nNotify-to-task latency, SEV/WFE mode (round-trip / 2):\n");
+        if (iccb_set_low_latency(true)) {
+            for (uint8_t i = 0; i < ICCB_ARRAY_LEN(latencySizes); i++) {
+                ok &= iccb_measure_latency(latencySizes[i]);
+            }
+        } else {
+            port->print(" responder did not switch modes\n");
+        }
+        ok &= iccb_set_low_latency(false);
+    }
+
+    port->print("\nThroughput:\n");
+    for (uint8_t i = 0; i < ICCB_ARRAY_LEN(streamSizes); i++) {
+        ok &= iccb_measure_throughput(streamSizes[i]);
+    }
+
+    port->print("\nPush cost:\n");
+    for (uint8_t i = 0; i < ICCB_ARRAY_LEN(streamSizes); i++) {
+        iccb_measure_push_cost(streamSizes[i]);
+    }
+
+    return ok;
+}
+
+static bool iccb_initiator_handler(const ICCB_MsgHeader *hdr) {
+    uint32_t now = port->get_cycles();
+    switch (hdr->type) {
+    case ICCB_MSG_PONG:
+        replyCycles = now - hdr->arg;
+        __atomic_store_n(&replySeq, hdr->seq, __ATOMIC_RELEASE);
+        break;
+    case ICCB_MSG_ACK:
+        replyCycles = hdr->arg;
+        __atomic_store_n(&replySeq, hdr->seq, __ATOMIC_RELEASE);
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+void iccb_initiator_recv(ICCQueue *q) {
+    if (!llInitiator) {
+        iccb_process(q, iccb_initiator_handler);
+    }
+}
+
+static bool iccb_responder_handler(const ICCB_MsgHeader *hdr) {
+    switch (hdr->type) {
+    case ICCB_MSG_PING:
+        iccb_send(queues->pong, ICCB_MSG_PONG, sizeof(ICCB_MsgHeader), hdr->seq, hdr->arg, 0); // never wait in the callback
+        break;
+    case ICCB_MSG_DATA:
+        rxBytes += hdr->len;
+        break;
+    case ICCB_MSG_END:
+        iccb_send(queues->pong, ICCB_MSG_ACK, sizeof(ICCB_MsgHeader), hdr->seq, rxBytes + hdr->len, 0);
+        rxBytes = 0;
+        break;
+    case ICCB_MSG_MODE:
+        modeMsg = *hdr;
+        modePending = true;
+        return false; // the queue changes hands, stop here
+    default:
+        break;
+    }
+    return true;
+}
+
+// apply a mode switch once the request has been popped
+static void iccb_responder_switch_mode() {
+    if (!modePending) {
+        return;
+    }
+
+    modePending = false;
+    llResponder = modeMsg.arg;
+    if (port->low_latency != NULL) {
+        port->low_latency(llResponder);
+    }
+    iccb_send(queues->pong, ICCB_MSG_ACK, sizeof(ICCB_MsgHeader), modeMsg.seq, 0, 0);
+}
+
+void iccb_responder_recv(ICCQueue *q) {
+    if ((q == queues->ping) && llResponder) {
+        return;
+    }
+
+    iccb_process(q, iccb_responder_handler);
+    iccb_responder_switch_mode();
+}
+
+void iccb_responder_serve() {
+    while (llResponder) {
+        if (port->wait(queues->ping, ICCB_LL_WAIT_US)) {
+            iccb_process(queues->ping, iccb_responder_handler);
+            iccb_responder_switch_mode();
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef ICC_ICC_BENCH
+#define ICC_ICC_BENCH
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "icc_queue.h"
+
+/**
+ * Platform dependent hooks of the benchmark. On target, a DWT CYCCNT and the HSEM
+ * doorbells are used, on the host a monotonic clock and condition variables stand in for them.
+ */
+typedef struct {
+    uint32_t (*get_cycles)();                   ///< Read the free-running cycle counter
+    uint32_t cyclesPerUs;                       ///< Cycle counter ticks per microsecond
+    void (*notify)(ICCQueue *q);                ///< Notify the peer about data written into q
+    void (*yield)();                            ///< Let the peer run while waiting (NULL: busy wait)
+    void (*print)(const char *format, ...);     ///< Print results
+    bool (*wait)(ICCQueue *q, uint32_t timeoutUs); ///< Wait for data on q in low-latency mode (NULL: mode not supported)
+    void (*low_latency)(bool en);               ///< Responder entered (left) low-latency mode, start (stop) calling iccb_responder_serve()
+} ICCB_Port;
+
+/**
+ * Benchmark queues. The initiator measures, the responder echoes and sinks.
+ */
+typedef struct {
+    ICCQueue *ping; ///< Initiator -> responder, latency probes (short messages)
+    ICCQueue *pong; ///< Responder -> initiator, probe replies and acknowledgements
+    ICCQueue *bulk; ///< Initiator -> responder, throughput stream
+} ICCB_Queues;
+
+#define ICCB_LATENCY_ROUNDS (1000)          // number of probes per message size
+#define ICCB_THROUGHPUT_BYTES (256 * 1024)  // bytes streamed per message size
+#define ICCB_PUSH_ROUNDS (256)              // push_n() calls timed per message size
+#define ICCB_TIMEOUT_US (100000)            // maximum time to wait for a reply
+#define ICCB_HIST_BINS (24)                 // latency histogram bins, bin k counts [2^k, 2^(k+1)) ns
+
+/**
+ * Latency histogram.
+ */
+typedef struct {
+    uint32_t cnt;                    ///< Number of samples
+    uint32_t lost;                   ///< Number of probes timed out
+    uint32_t minNs;                  ///< Minimum latency [ns]
+    uint32_t maxNs;                  ///< Maximum latency [ns]
+    uint64_t sumNs;                  ///< Sum of latencies [ns]
+    uint32_t bins[ICCB_HIST_BINS];   ///< Histogram bins
+} ICCB_Histogram;
+
+#define ICCB_LL_WAIT_US (1000) // low-latency wait period of the responder
+
+/**
+ * Initialize the benchmark.
+ * @param port pointer to the platform hooks (MUST remain valid)
+ * @param queues pointer to the queue set (MUST remain valid)
+ */
+void iccb_init(const ICCB_Port *port, const ICCB_Queues *queues);
+
+/**
+ * Run all measurements and print the results. Blocks until done.
+ * MUST be called in the initiator's task context.
+ * @return true if no message was lost
+ */
+bool iccb_run();
+
+/**
+ * Process messages received by the initiator (call on the 'pong' notification).
+ * @param q the 'pong' queue
+ */
+void iccb_initiator_recv(ICCQueue *q);
+
+/**
+ * Process messages received by the responder (call on 'ping' and 'bulk' notifications).
+ * Ignores the 'ping' queue while the responder is in low-latency mode.
+ * @param q the queue that has been notified
+ */
+void iccb_responder_recv(ICCQueue *q);
+
+/**
+ * Serve the 'ping' queue in low-latency mode, returns when the mode is left.
+ * MUST be called from a dedicated task after the low_latency(true) hook.
+ */
+void iccb_responder_serve();
+
+// ------ TARGET (icc_bench_port.c) --------
+
+/**
+ * Hook the benchmark into the ICC channels. CM4 is the initiator, CM7 is the responder.
+ */
+void icc_bench_init();
+
+/**
+ * Run the benchmark (CM4 ONLY).
+ * @return true if no message was lost
+ */
+bool icc_bench_run();
+
+#endif /* ICC_ICC_BENCH */
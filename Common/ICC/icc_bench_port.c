@@ -0,0 +1,99 @@
+#include "icc_bench.h"
+#include "icc.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <stm32h7xx_hal.h>
+
+#include <cmsis_os2.h>
+
+#include <standard_output/standard_output.h>
+
+extern ICC_SharedData sharedData;
+
+static const ICCB_Queues queues = {
+    &(sharedData.queues[ICC_CH_CONTROL_M7]), // ping
+    &(sharedData.queues[ICC_CH_CONTROL_M4]), // pong
+    &(sharedData.queues[ICC_CH_BENCH])       // bulk
+};
+
+static uint32_t icc_bench_get_cycles() {
+    return DWT->CYCCNT;
+}
+
+static void icc_bench_notify(ICCQueue *q) {
+    icc_notify_channel((ICC_ChannelId)(q - sharedData.queues));
+}
+
+static bool icc_bench_wait(ICCQueue *q, uint32_t timeoutUs) {
+    return icc_wait_sev((ICC_ChannelId)(q - sharedData.queues), timeoutUs);
+}
+
+#ifdef CORE_CM7
+
+#define ICC_BENCH_LL_FLAG (0x01) // responder entered low-latency mode
+
+static osEventFlagsId_t benchEvt = NULL;
+
+static void icc_bench_low_latency(bool en) {
+    if (en) {
+        osEventFlagsSet(benchEvt, ICC_BENCH_LL_FLAG);
+    }
+}
+
+// dedicated consumer of the 'ping' queue in low-latency mode
+static void icc_bench_thread(void *arg) {
+    while (true) {
+        osEventFlagsWait(benchEvt, ICC_BENCH_LL_FLAG, osFlagsWaitAny, osWaitForever);
+        iccb_responder_serve();
+    }
+}
+
+#else
+#define icc_bench_low_latency (NULL)
+#endif
+
+static ICCB_Port port = {
+    icc_bench_get_cycles,
+    0, // filled in by icc_bench_init()
+    icc_bench_notify,
+    NULL, // busy wait, the peer core runs in parallel
+    MSG,
+    icc_bench_wait,
+    icc_bench_low_latency};
+
+static void icc_bench_recv_cb(ICC_ChannelId ch, ICCQueue *q) {
+#ifdef CORE_CM7
+    iccb_responder_recv(q);
+#else
+    iccb_initiator_recv(q);
+#endif
+}
+
+void icc_bench_init() {
+    icc_start_cycle_counter();
+    port.cyclesPerUs = SystemCoreClock / 1000000;
+
+    iccb_init(&port, &queues);
+
+#ifdef CORE_CM7
+    benchEvt = osEventFlagsNew(NULL);
+
+    osThreadAttr_t attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.stack_size = 1024;
+    attr.name = "bench";
+    attr.priority = osPriorityAboveNormal; // keeps the core while serving the benchmark
+    osThreadNew(icc_bench_thread, NULL, &attr);
+
+    icc_register_recv_cb(ICC_CH_CONTROL_M7, icc_bench_recv_cb);
+    icc_register_recv_cb(ICC_CH_BENCH, icc_bench_recv_cb);
+#else
+    icc_register_recv_cb(ICC_CH_CONTROL_M4, icc_bench_recv_cb);
+#endif
+}
+
+bool icc_bench_run() {
+    return iccb_run();
+}
@@ -0,0 +1,250 @@
+#include "icc_blob.h"
+#include "icc.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <stm32h7xx_hal.h>
+
+#include <cmsis_os2.h>
+
+extern ICC_SharedData sharedData;
+
+#define WINDOWS (sharedData.blobWindows)
+
+#define ICC_BLOB_EVT_FLAG (0x01) // window state has changed
+
+static osEventFlagsId_t blobEvt = NULL; // window state change signal
+
+// ring a blob semaphore
+static void icc_blob_signal(uint8_t semId) {
+    if (HAL_HSEM_FastTake(semId) == HAL_OK) {
+        HAL_HSEM_Release(semId, 0);
+    }
+}
+
+#ifdef CORE_CM7
+
+// ------ RECEIVER --------
+
+static ICC_BlobSink blobSink = NULL; // sink function
+static uint8_t nextRx = 0;           // next window to process
+
+void icc_blob_init() {
+    for (uint8_t i = 0; i < ICC_BLOB_WINDOW_CNT; i++) {
+        memset((void *)&WINDOWS[i], 0, offsetof(ICC_BlobWindow, data));
+        WINDOWS[i].owner = ICC_BLOB_OWNER_CM4;
+    }
+}
+
+static void icc_blob_thread(void *arg) {
+    while (true) {
+        osEventFlagsWait(blobEvt, ICC_BLOB_EVT_FLAG, osFlagsWaitAny, osWaitForever);
+
+        // process filled windows in order
+        ICC_BlobWindow *win = &WINDOWS[nextRx];
+        while (__atomic_load_n(&win->owner, __ATOMIC_ACQUIRE) == ICC_BLOB_OWNER_CM7) {
+            ICC_BlobChunk chunk = {win->blobId, win->tag, win->flags, win->offset, win->len, win->data};
+            blobSink(&chunk);
+
+            // hand the window back
+            __atomic_store_n(&win->owner, ICC_BLOB_OWNER_CM4, __ATOMIC_RELEASE);
+            icc_blob_signal(ICC_BLOB_FREE_SEMID);
+
+            nextRx = (nextRx + 1) % ICC_BLOB_WINDOW_CNT;
+            win = &WINDOWS[nextRx];
+        }
+    }
+}
+
+void icc_blob_set_sink(ICC_BlobSink sink) {
+    blobSink = sink;
+
+    if (blobEvt == NULL) {
+        blobEvt = osEventFlagsNew(NULL);
+
+        osThreadAttr_t attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.stack_size = 1024;
+        attr.name = "blob";
+        osThreadNew(icc_blob_thread, NULL, &attr);
+
+        osEventFlagsSet(blobEvt, ICC_BLOB_EVT_FLAG); // serve windows filled in the meantime
+    }
+}
+
+uint32_t icc_blob_get_sem_mask() {
+    return __HAL_HSEM_SEMID_TO_MASK(ICC_BLOB_READY_SEMID);
+}
+
+void icc_blob_dispatch(uint32_t semMask) {
+    uint32_t mask = __HAL_HSEM_SEMID_TO_MASK(ICC_BLOB_READY_SEMID);
+    if (semMask & mask) {
+        if (blobEvt != NULL) {
+            osEventFlagsSet(blobEvt, ICC_BLOB_EVT_FLAG);
+        }
+        HAL_HSEM_ActivateNotification(mask);
+    }
+}
+
+#else
+
+// ------ SENDER --------
+
+static osMutexId_t blobMtx = NULL;  // serializes blobs
+static uint32_t blobId = 0;         // current blob ID
+static uint16_t blobTag;            // current blob tag
+static uint32_t blobOffset;         // bytes of the current blob already submitted
+static bool blobFirst;              // next submitted chunk is the first
+static bool blobAborted;            // current blob has been aborted
+static ICC_BlobWindow *fillWin;     // window being filled, NULL if none
+static uint8_t nextTx = 0;          // next window to fill
+
+// completion callbacks of submitted last chunks, one per window
+static ICC_BlobDoneCb doneCbs[ICC_BLOB_WINDOW_CNT];
+static void *doneArgs[ICC_BLOB_WINDOW_CNT];
+static bool doneOk[ICC_BLOB_WINDOW_CNT];
+
+// invoke the completion callback of a released window, exactly once even if both the sender task and the interrupt try it
+static void icc_blob_report_done(uint8_t i) {
+    ICC_BlobDoneCb cb = __atomic_exchange_n(&doneCbs[i], NULL, __ATOMIC_ACQUIRE);
+    if (cb != NULL) {
+        cb(WINDOWS[i].blobId, doneOk[i], doneArgs[i]);
+    }
+}
+
+// get the next free window
+static ICC_BlobWindow *icc_blob_acquire_window() {
+    ICC_BlobWindow *win = &WINDOWS[nextTx];
+    uint32_t start = osKernelGetTickCount();
+    while (__atomic_load_n(&win->owner, __ATOMIC_ACQUIRE) != ICC_BLOB_OWNER_CM4) {
+        uint32_t elapsed = osKernelGetTickCount() - start;
+        if (elapsed >= ICC_BLOB_TIMEOUT_MS) {
+            return NULL;
+        }
+        osEventFlagsWait(blobEvt, ICC_BLOB_EVT_FLAG, osFlagsWaitAny, ICC_BLOB_TIMEOUT_MS - elapsed);
+    }
+
+    icc_blob_report_done(nextTx); // the interrupt might not have run yet
+    win->len = 0;
+    return win;
+}
+
+// pass the window being filled to the receiver
+static void icc_blob_submit(uint16_t flags, ICC_BlobDoneCb cb, void *arg) {
+    ICC_BlobWindow *win = fillWin;
+    win->blobId = blobId;
+    win->tag = blobTag;
+    win->flags = flags | (blobFirst ? ICC_BLOB_FIRST : 0);
+    win->offset = blobOffset;
+
+    doneArgs[nextTx] = arg;
+    doneOk[nextTx] = !(flags & ICC_BLOB_ABORTED);
+    __atomic_store_n(&doneCbs[nextTx], cb, __ATOMIC_RELEASE);
+
+    blobOffset += win->len;
+    blobFirst = false;
+    fillWin = NULL;
+    nextTx = (nextTx + 1) % ICC_BLOB_WINDOW_CNT;
+
+    // window content must be visible before the ownership changes
+    __atomic_store_n(&win->owner, ICC_BLOB_OWNER_CM7, __ATOMIC_RELEASE);
+    icc_blob_signal(ICC_BLOB_READY_SEMID);
+}
+
+uint32_t icc_blob_begin(uint16_t tag) {
+    if (blobMtx == NULL) {
+        blobMtx = osMutexNew(NULL);
+        blobEvt = osEventFlagsNew(NULL);
+    }
+
+    osMutexAcquire(blobMtx, osWaitForever);
+
+    blobId++;
+    blobTag = tag;
+    blobOffset = 0;
+    blobFirst = true;
+    blobAborted = false;
+    fillWin = NULL;
+
+    return blobId;
+}
+
+bool icc_blob_write(const void *data, uint32_t len) {
+    const uint8_t *src = (const uint8_t *)data;
+    while ((len > 0) && !blobAborted) {
+        // get a window if there's none
+        if (fillWin == NULL) {
+            fillWin = icc_blob_acquire_window();
+            if (fillWin == NULL) {
+                blobAborted = true;
+                break;
+            }
+        }
+
+        // copy as much as fits
+        uint32_t copyLen = ICC_BLOB_WINDOW_SIZE - fillWin->len;
+        copyLen = (copyLen < len) ? copyLen : len;
+        memcpy(fillWin->data + fillWin->len, src, copyLen);
+        fillWin->len += copyLen;
+        src += copyLen;
+        len -= copyLen;
+
+        // submit a full window
+        if (fillWin->len == ICC_BLOB_WINDOW_SIZE) {
+            icc_blob_submit(0, NULL, NULL);
+        }
+    }
+
+    return !blobAborted;
+}
+
+bool icc_blob_end(ICC_BlobDoneCb cb, void *arg) {
+    // close the blob with a (possibly empty) last chunk
+    if (fillWin == NULL) {
+        fillWin = icc_blob_acquire_window();
+    }
+
+    bool ok = !blobAborted;
+    if (fillWin != NULL) {
+        icc_blob_submit(ICC_BLOB_LAST | (ok ? 0 : ICC_BLOB_ABORTED), cb, arg);
+    } else if (cb != NULL) {
+        ok = false;
+        cb(blobId, false, arg); // the receiver is stuck, cannot even tell it about the abort
+    }
+
+    osMutexRelease(blobMtx);
+    return ok;
+}
+
+bool icc_blob_send(uint16_t tag, const void *data, uint32_t len, ICC_BlobDoneCb cb, void *arg) {
+    icc_blob_begin(tag);
+    icc_blob_write(data, len);
+    return icc_blob_end(cb, arg);
+}
+
+uint32_t icc_blob_get_sem_mask() {
+    return __HAL_HSEM_SEMID_TO_MASK(ICC_BLOB_FREE_SEMID);
+}
+
+void icc_blob_dispatch(uint32_t semMask) {
+    uint32_t mask = __HAL_HSEM_SEMID_TO_MASK(ICC_BLOB_FREE_SEMID);
+    if (!(semMask & mask)) {
+        return;
+    }
+
+    // report completed blobs
+    for (uint8_t i = 0; i < ICC_BLOB_WINDOW_CNT; i++) {
+        if (__atomic_load_n(&WINDOWS[i].owner, __ATOMIC_ACQUIRE) == ICC_BLOB_OWNER_CM4) {
+            icc_blob_report_done(i);
+        }
+    }
+
+    // wake up the sender waiting for a window
+    if (blobEvt != NULL) {
+        osEventFlagsSet(blobEvt, ICC_BLOB_EVT_FLAG);
+    }
+    HAL_HSEM_ActivateNotification(mask);
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef ICC_ICC_BLOB
+#define ICC_ICC_BLOB
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ICC_BLOB_WINDOW_SIZE (4096)  // size of a transfer window
+#define ICC_BLOB_WINDOW_CNT (2)      // number of transfer windows (double buffering)
+#define ICC_BLOB_READY_SEMID (13)    // semaphore ID signalling a filled window to the CM7 core
+#define ICC_BLOB_FREE_SEMID (14)     // semaphore ID signalling a released window to the CM4 core
+#define ICC_BLOB_TIMEOUT_MS (2000)   // maximum time to wait for a free window
+
+/**
+ * Window owners.
+ */
+typedef enum {
+    ICC_BLOB_OWNER_CM4, ///< Window is free, the sender may fill it
+    ICC_BLOB_OWNER_CM7  ///< Window is filled, the receiver is processing it
+} ICC_BlobOwner;
+
+/**
+ * Chunk flags.
+ */
+typedef enum {
+    ICC_BLOB_FIRST = 0x01,  ///< First chunk of a blob
+    ICC_BLOB_LAST = 0x02,   ///< Last chunk of a blob
+    ICC_BLOB_ABORTED = 0x04 ///< Blob has been abandoned by the sender, preceding data is incomplete
+} ICC_BlobFlags;
+
+/**
+ * Transfer window in the shared memory.
+ */
+typedef struct {
+    volatile uint32_t owner;                                       ///< Current owner (ICC_BlobOwner)
+    uint32_t blobId;                                               ///< Blob identifier
+    uint16_t tag;                                                  ///< User defined content tag
+    uint16_t flags;                                                ///< Chunk flags (ICC_BlobFlags)
+    uint32_t offset;                                               ///< Offset of the chunk in the blob
+    uint32_t len;                                                  ///< Chunk length
+    uint8_t data[ICC_BLOB_WINDOW_SIZE] __attribute__((aligned(32))); ///< Chunk data
+} ICC_BlobWindow;
+
+/**
+ * Blob chunk information passed to the receiver.
+ */
+typedef struct {
+    uint32_t blobId;   ///< Blob identifier
+    uint16_t tag;      ///< User defined content tag
+    uint16_t flags;    ///< Chunk flags (ICC_BlobFlags)
+    uint32_t offset;   ///< Offset of the chunk in the blob
+    uint32_t len;      ///< Chunk length
+    const void *data;  ///< Chunk data, only valid during the sink call
+} ICC_BlobChunk;
+
+/**
+ * Blob sink on the receiving core, called in task context in blob order.
+ * The chunk is released to the sender after the sink returns.
+ * @param chunk pointer to the chunk
+ */
+typedef void (*ICC_BlobSink)(const ICC_BlobChunk *chunk);
+
+/**
+ * Completion callback on the sending core, called once the receiver has processed the last chunk
+ * (from the HSEM interrupt or from the sending task when it reuses the window).
+ * @param blobId blob identifier
+ * @param ok blob has been transferred completely
+ * @param arg user argument
+ */
+typedef void (*ICC_BlobDoneCb)(uint32_t blobId, bool ok, void *arg);
+
+// ------ CM7 ONLY --------
+
+/**
+ * Initialize the transfer windows.
+ */
+void icc_blob_init();
+
+/**
+ * Set the sink receiving the blobs and start the receiver task.
+ * @param sink sink function
+ */
+void icc_blob_set_sink(ICC_BlobSink sink);
+
+// ------ CM4 ONLY --------
+
+/**
+ * Begin a new blob. Blobs are serialized, this call waits until the previous blob is ended.
+ * MUST be called from task context.
+ * @param tag user defined content tag
+ * @return blob identifier
+ */
+uint32_t icc_blob_begin(uint16_t tag);
+
+/**
+ * Append data to the current blob. Filled windows are passed to the receiver,
+ * waits for a free window at most ICC_BLOB_TIMEOUT_MS.
+ * @param data pointer to the data
+ * @param len data length
+ * @return false if the receiver did not release a window in time (the blob becomes aborted)
+ */
+bool icc_blob_write(const void *data, uint32_t len);
+
+/**
+ * End the current blob.
+ * @param cb completion callback (might be NULL)
+ * @param arg user argument passed to the callback
+ * @return false if the blob has been aborted
+ */
+bool icc_blob_end(ICC_BlobDoneCb cb, void *arg);
+
+/**
+ * Transfer a whole blob, combines icc_blob_begin(), icc_blob_write() and icc_blob_end().
+ * @param tag user defined content tag
+ * @param data pointer to the data
+ * @param len data length
+ * @param cb completion callback (might be NULL)
+ * @param arg user argument passed to the callback
+ * @return false if the transfer has been aborted
+ */
+bool icc_blob_send(uint16_t tag, const void *data, uint32_t len, ICC_BlobDoneCb cb, void *arg);
+
+// ------ IMPLEMENTED ON BOTH CORES --------
+
+/**
+ * Get the blob semaphore mask notifying this core.
+ * @return semaphore mask
+ */
+uint32_t icc_blob_get_sem_mask();
+
+/**
+ * Handle blob notifications, called by icc_dispatch().
+ * @param semMask mask of the freed semaphores
+ */
+void icc_blob_dispatch(uint32_t semMask);
+
+#endif /* ICC_ICC_BLOB */
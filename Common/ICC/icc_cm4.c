@@ -2,11 +2,7 @@
 
 #include "stm32h7xx_hal.h"
 
-ICC_SharedData sharedData __attribute__((section(".icc_section")));
-
-__weak void icc_recv_cb() {
-    return;
-}
+#define ICC_PEER_SEV_EXTI_LINE (EXTI_LINE65) // CM7 SEV event input (see icc_wait_sev())
 
 void icc_wait_for_M7_bootup() {
     // enable HSEM clock
@@ -30,33 +26,21 @@ void icc_wait_for_M7_bootup() {
 }
 
 void icc_open_pipe() {
-    HAL_HSEM_ActivateNotification(__HAL_HSEM_SEMID_TO_MASK(ICC_FOURBOUND_SEMID));
+    icc_init_flow_control();
+
+    // let the CM7's SEV wake this core from WFE
+    HAL_EXTI_D2_EventInputConfig(ICC_PEER_SEV_EXTI_LINE, EXTI_MODE_EVT, ENABLE);
+    icc_start_cycle_counter();
+
+    HAL_HSEM_ActivateNotification(icc_get_inbound_sem_mask());
     HAL_NVIC_SetPriority(HSEM2_IRQn, 0x7, 0);
     HAL_NVIC_EnableIRQ(HSEM2_IRQn);
 }
 
 void HAL_HSEM_FreeCallback(uint32_t SemMask) {
-    icc_recv_cb();
-    //usb_cdc_write("IRQ\r\n", 5);
-    HAL_HSEM_ActivateNotification(__HAL_HSEM_SEMID_TO_MASK(ICC_FOURBOUND_SEMID));
+    icc_dispatch(SemMask);
 }
 
 void HSEM2_IRQHandler() {
     HAL_HSEM_IRQHandler();
 }
-
-void icc_notify() {
-    if (HAL_HSEM_FastTake(ICC_SEVENBOUND_SEMID) == HAL_OK) {
-        HAL_HSEM_Release(ICC_SEVENBOUND_SEMID, 0);
-    }
-}
-
-// ---------------
-
-ICCQueue * icc_get_outbound_pipe() {
-    return &(sharedData.sevenBound);
-}
-
-ICCQueue * icc_get_inbound_pipe() {
-    return &(sharedData.fourBound);
-}
\ No newline at end of file
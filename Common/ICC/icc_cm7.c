@@ -1,15 +1,41 @@
 #include "icc.h"
 
-#include <stm32h7xx_hal.h>
+#include <string.h>
 
-volatile ICC_SharedData sharedData __attribute__((section(".icc_section")));
+#include <stm32h7xx_hal.h>
 
-__weak void icc_recv_cb() {
-    return;
-}
+extern ICC_SharedData sharedData;
 
 //HSEM_Common_TypeDef * hsem = HSEM_COMMON;
 
+#define ICC_SHARED_MEM_BASE (0x30040000)              // SRAM3 holding the .icc_section (see shared.ld)
+#define ICC_SHARED_MEM_MPU_SIZE (MPU_REGION_SIZE_32KB) // size of SRAM3
+#define ICC_MPU_REGION_NUMBER (MPU_REGION_NUMBER0)     // MPU region excluding the shared memory from caching
+#define ICC_PEER_SEV_EXTI_LINE (EXTI_LINE66)           // CM4 SEV event input (see icc_wait_sev())
+
+// make the shared memory non-cacheable, so that the CM7 D-cache can be safely enabled
+static void icc_configure_mpu() {
+    MPU_Region_InitTypeDef region;
+    memset(&region, 0, sizeof(region));
+
+    HAL_MPU_Disable();
+
+    region.Enable = MPU_REGION_ENABLE;
+    region.Number = ICC_MPU_REGION_NUMBER;
+    region.BaseAddress = ICC_SHARED_MEM_BASE;
+    region.Size = ICC_SHARED_MEM_MPU_SIZE;
+    region.SubRegionDisable = 0x00;
+    region.TypeExtField = MPU_TEX_LEVEL1; // normal memory, non-cacheable
+    region.AccessPermission = MPU_REGION_FULL_ACCESS;
+    region.DisableExec = MPU_INSTRUCTION_ACCESS_DISABLE;
+    region.IsShareable = MPU_ACCESS_SHAREABLE;
+    region.IsCacheable = MPU_ACCESS_NOT_CACHEABLE;
+    region.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
+    HAL_MPU_ConfigRegion(&region);
+
+    HAL_MPU_Enable(MPU_PRIVILEGED_DEFAULT);
+}
+
 void icc_wake_up_M4() {
     // enable HSEM clock
     __HAL_RCC_HSEM_CLK_ENABLE();
@@ -22,13 +48,41 @@ void icc_wake_up_M4() {
 }
 
 void icc_init() {
-    iccq_create(&(sharedData.fourBound), sharedData.pFourBound, ICC_QUEUE_LENGTH, 1);
-    iccq_create(&(sharedData.sevenBound), sharedData.pSevenBound, ICC_QUEUE_LENGTH, 1);
+    // exclude the shared memory from caching
+    icc_configure_mpu();
+
+    // data areas in ICC_CH_* order
+    volatile uint8_t *areas[ICC_CH_COUNT] = {
+        sharedData.pControlM7,
+        sharedData.pControlM4,
+        sharedData.pCliInput,
+        sharedData.pConsole,
+        sharedData.pTelemetry,
+        sharedData.pBench,
+    };
+
+    for (uint8_t ch = 0; ch < ICC_CH_COUNT; ch++) {
+        iccq_create(icc_get_channel(ch), areas[ch], icc_get_channel_desc(ch)->length, 1);
+    }
+
+    icc_state_init();
+    icc_blob_init();
+
+    // no producer is waiting for space, no consumer is waiting for events
+    memset((void *)sharedData.spaceWanted, 0, sizeof(sharedData.spaceWanted));
+    memset((void *)sharedData.sevWaiting, 0, sizeof(sharedData.sevWaiting));
+    memset((void *)sharedData.notifyStats, 0, sizeof(sharedData.notifyStats));
 }
 
 void icc_open_pipe() {
+    icc_init_flow_control();
+
+    // let the CM4's SEV wake this core from WFE
+    HAL_EXTI_D1_EventInputConfig(ICC_PEER_SEV_EXTI_LINE, EXTI_MODE_EVT, ENABLE);
+    icc_start_cycle_counter();
+
     // uint32_t a = hsem->IER;
-    HAL_HSEM_ActivateNotification(__HAL_HSEM_SEMID_TO_MASK(ICC_SEVENBOUND_SEMID));
+    HAL_HSEM_ActivateNotification(icc_get_inbound_sem_mask());
     HAL_NVIC_SetPriority(HSEM1_IRQn, 0x7, 0);
     HAL_NVIC_EnableIRQ(HSEM1_IRQn);
 }
@@ -38,23 +92,6 @@ void HSEM1_IRQHandler() {
 }
 
 void HAL_HSEM_FreeCallback(uint32_t SemMask) {
-    icc_recv_cb();
-    HAL_HSEM_ActivateNotification(__HAL_HSEM_SEMID_TO_MASK(ICC_SEVENBOUND_SEMID));
+    icc_dispatch(SemMask);
     return;
 }
-
-void icc_notify() {
-    HAL_HSEM_FastTake(ICC_FOURBOUND_SEMID);
-    HAL_HSEM_Release(ICC_FOURBOUND_SEMID, 0);
-}
-
-
-// ------
-
-ICCQueue * icc_get_outbound_pipe() {
-    return &(sharedData.fourBound);
-}
-
-ICCQueue * icc_get_inbound_pipe() {
-    return &(sharedData.sevenBound);
-}
\ No newline at end of file
@@ -1,50 +1,197 @@
 #include "icc_queue.h"
 #include <string.h>
 
-void iccq_create(ICCQueue * q, volatile uint8_t * p, uint32_t length, uint32_t elemSize) {
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+// Ordering of index accesses; the producer publishes the write index only after
+// the elements have been stored, the consumer releases the read index only after
+// the elements have been fetched. Compiles to a DMB on the Cortex-M cores.
+#define ICCQ_LOAD_ACQUIRE(idx) __atomic_load_n(&(idx), __ATOMIC_ACQUIRE)
+#define ICCQ_STORE_RELEASE(idx, val) __atomic_store_n(&(idx), (val), __ATOMIC_RELEASE)
+
+#define ICCQ_NO_PADDING (0xFFFFFFFF) // distance of the padding if none is outstanding
+
+void iccq_create(ICCQueue *q, volatile uint8_t *p, uint32_t length, uint32_t elemSize) {
+    // round length down to the nearest power of two
+    while (length & (length - 1)) {
+        length &= length - 1;
+    }
+
     q->elements = p;
     q->length = length;
+    q->mask = length - 1;
     q->elemSize = elemSize;
     q->readIdx = 0;
     q->writeIdx = 0;
-    memset(q->elements, 0, length * elemSize);
+    q->padIdx = 0;
+    q->padCnt = 0;
+    q->padSkipped = 0;
+    iccq_clear_stats(q);
+    memset((uint8_t *)q->elements, 0, length * elemSize);
+}
 
-    return q;
+void iccq_clear_stats(ICCQueue *q) {
+    q->pushed = 0;
+    q->pushFails = 0;
+    q->highWater = 0;
+    q->popped = 0;
 }
 
-void iccq_clear(ICCQueue * q) {
+// update the producer statistics
+static void iccq_account_push(ICCQueue *q, uint32_t r, uint32_t w, uint32_t n) {
+    q->pushed += n;
+    if ((w - r) > q->highWater) {
+        q->highWater = w - r;
+    }
+}
+
+void iccq_clear(ICCQueue *q) {
     q->readIdx = 0;
     q->writeIdx = 0;
-    memset(q->elements, 0, q->length * q->elemSize);
+    q->padIdx = 0;
+    q->padCnt = 0;
+    q->padSkipped = 0;
+    memset((uint8_t *)q->elements, 0, q->length * q->elemSize);
+}
+
+uint32_t iccq_avail(const ICCQueue *q) {
+    return ICCQ_LOAD_ACQUIRE(q->writeIdx) - ICCQ_LOAD_ACQUIRE(q->readIdx);
+}
+
+uint32_t iccq_free(const ICCQueue *q) {
+    return q->length - iccq_avail(q);
+}
+
+// copy n elements into the queue starting at (free-running) index idx, handle rollover
+static void iccq_copy_in(ICCQueue *q, uint32_t idx, const uint8_t *src, uint32_t n) {
+    uint32_t pos = idx & q->mask;
+    uint32_t first = MIN(n, q->length - pos); // elements to the end of the memory block
+    uint8_t *elems = (uint8_t *)q->elements;
+    memcpy(elems + pos * q->elemSize, src, first * q->elemSize);
+    if (n > first) {
+        memcpy(elems, src + first * q->elemSize, (n - first) * q->elemSize);
+    }
 }
 
-uint32_t iccq_avail(const ICCQueue * q) {
-    return ((q->writeIdx < q->readIdx) ? (q->writeIdx + q->length) : (q->writeIdx)) - q->readIdx;
+bool iccq_push(ICCQueue *q, const void *src) {
+    return iccq_push_n(q, src, 1) == 1;
 }
 
-#define MQ_NEXT(size,current) (((current)+1)%(size))
+uint32_t iccq_push_n(ICCQueue *q, const void *src, uint32_t n) {
+    uint32_t w = q->writeIdx;                         // only the producer writes this index
+    uint32_t r = ICCQ_LOAD_ACQUIRE(q->readIdx);       // slots released by the consumer
+    if (n > (q->length - (w - r))) {                  // cannot push more than the free space
+        n = q->length - (w - r);
+        q->pushFails++;
+    }
+    if (n == 0) {                                     // cannot push, queue is full
+        return 0;
+    }
+
+    // copy elements
+    iccq_copy_in(q, w, (const uint8_t *)src, n);
+
+    // publish elements by advancing the write index
+    ICCQ_STORE_RELEASE(q->writeIdx, w + n);
+    iccq_account_push(q, r, w + n, n);
 
-bool iccq_push(ICCQueue * q, const void * src) {
-    if (MQ_NEXT(q->length, q->writeIdx) == q->readIdx) { // cannot push, queue is full
-        return false;
+    return n;
+}
+
+void iccq_top(ICCQueue *q, void *dest) {
+    const void *p;
+    if (iccq_peek_contig(q, &p) > 0) {
+        memcpy(dest, p, q->elemSize);
     }
+}
+
+void iccq_pop(ICCQueue *q) {
+    iccq_pop_n(q, NULL, 1);
+}
 
-    // can push
-    memcpy(q->elements + q->writeIdx * q->elemSize, src, q->elemSize);
+uint32_t iccq_pop_n(ICCQueue *q, void *dest, uint32_t n) {
+    uint32_t popped = 0;
+    while (popped < n) { // at most two blocks (three if a padding is skipped)
+        const void *p;
+        uint32_t len = MIN(iccq_peek_contig(q, &p), n - popped);
+        if (len == 0) {
+            break;
+        }
 
-    // advance write pointer
-    q->writeIdx = MQ_NEXT(q->length, q->writeIdx);
+        // copy elements if requested
+        if (dest != NULL) {
+            memcpy((uint8_t *)dest + popped * q->elemSize, p, len * q->elemSize);
+        }
 
-    return true;
+        // hand the slots back to the producer
+        ICCQ_STORE_RELEASE(q->readIdx, q->readIdx + len);
+        popped += len;
+        q->popped += len;
+    }
+
+    return popped;
 }
 
-void iccq_top(ICCQueue * q, void * dest) {
-    memcpy(dest, q->elements + q->readIdx, q->elemSize);
+uint32_t iccq_peek_contig(ICCQueue *q, const void **pp) {
+    uint32_t r = q->readIdx;                     // only the consumer writes this index
+    uint32_t w = ICCQ_LOAD_ACQUIRE(q->writeIdx); // elements published by the producer
+    uint32_t padOffset = ICCQ_NO_PADDING;
+
+    // a padding not skipped yet is always at or ahead of the read index
+    if (ICCQ_LOAD_ACQUIRE(q->padCnt) != q->padSkipped) {
+        padOffset = q->padIdx - r;
+    }
+
+    // skip the padding if the read index has reached it, acknowledge it so it never matches again
+    if ((padOffset == 0) && (w != r)) {
+        r += q->length - (r & q->mask);
+        q->padSkipped++;
+        ICCQ_STORE_RELEASE(q->readIdx, r);
+        padOffset = ICCQ_NO_PADDING;
+    }
+
+    uint32_t pos = r & q->mask;
+    *pp = (const void *)(q->elements + pos * q->elemSize);
+    uint32_t len = MIN(w - r, q->length - pos); // stop at the end of the memory block...
+    return MIN(len, padOffset);                 // ...or at the padding
 }
 
-void iccq_pop(ICCQueue * q) {
-    if (iccq_avail(q) > 0) { // if there's something to pop
-        q->readIdx = MQ_NEXT(q->length, q->readIdx);
+void *iccq_reserve(ICCQueue *q, uint32_t n) {
+    uint32_t w = q->writeIdx;
+    uint32_t r = ICCQ_LOAD_ACQUIRE(q->readIdx);
+    uint32_t free = q->length - (w - r);
+    uint32_t pos = w & q->mask;
+    uint32_t tail = q->length - pos; // elements to the end of the memory block
+
+    if (n == 0) {
+        return NULL;
+    }
+
+    if (free < n) { // not enough space at all
+        q->pushFails++;
+        return NULL;
     }
+
+    if (tail < n) { // block does not fit into the tail, wrap around
+        if (free < tail + n) {
+            q->pushFails++;
+            return NULL;
+        }
+
+        // publish the tail as padding, the consumer will skip it
+        // (the previous one has been skipped already, otherwise the space check would have failed)
+        q->padIdx = w;
+        ICCQ_STORE_RELEASE(q->padCnt, q->padCnt + 1);
+        ICCQ_STORE_RELEASE(q->writeIdx, w + tail);
+        pos = 0;
+    }
+
+    return (void *)(q->elements + pos * q->elemSize);
 }
 
+void iccq_commit(ICCQueue *q, uint32_t n) {
+    // publish the written elements
+    uint32_t w = q->writeIdx + n;
+    ICCQ_STORE_RELEASE(q->writeIdx, w);
+    iccq_account_push(q, __atomic_load_n(&q->readIdx, __ATOMIC_RELAXED), w, n);
+}
@@ -4,44 +4,73 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#define ICCQ_CACHE_LINE_SIZE (32) // size of a cache line, indices owned by different cores are kept in separate lines
+
 /**
- * Generic Queue.
+ * Single-producer, single-consumer lock-free Queue.
+ * The write index is only written by the producer, the read index is only written by the consumer.
+ * Indices are free-running, they are masked only when addressing the element area,
+ * therefore the full capacity of the circular buffer is usable.
+ * A reservation not fitting into the tail of the element area wraps to the beginning,
+ * the skipped tail (padding) is never handed to the consumer. At most one padding is
+ * outstanding at a time, the consumer acknowledges it by advancing its skip counter.
+ * Statistics are kept next to the index of the side updating them.
  */
 typedef struct _ICCQueue {
-    uint32_t writeIdx; ///< Next block to write
-    uint32_t readIdx; ///< Next block to read
-    uint32_t length; ///< Size of circular buffer
-    uint32_t elemSize; ///< Element size
-    volatile uint8_t * elements; ///< Array of packets
+    volatile uint32_t writeIdx __attribute__((aligned(ICCQ_CACHE_LINE_SIZE))); ///< Next block to write (free-running)
+    volatile uint32_t padIdx;                                                  ///< Beginning of the unused tail left by a wrapped reservation
+    volatile uint32_t padCnt;                                                  ///< Paddings published, padIdx is valid while it differs from padSkipped
+    volatile uint32_t pushed;                                                  ///< Elements pushed or committed (producer statistics)
+    volatile uint32_t pushFails;                                               ///< Pushes and reservations that did not fit entirely
+    volatile uint32_t highWater;                                               ///< Maximum fill level seen by the producer, including padding
+    volatile uint32_t readIdx __attribute__((aligned(ICCQ_CACHE_LINE_SIZE)));  ///< Next block to read (free-running)
+    volatile uint32_t padSkipped;                                              ///< Paddings skipped by the consumer
+    volatile uint32_t popped;                                                  ///< Elements popped (consumer statistics)
+    uint32_t length __attribute__((aligned(ICCQ_CACHE_LINE_SIZE)));            ///< Size of circular buffer (power of two)
+    uint32_t mask;                                                             ///< Index mask (length - 1)
+    uint32_t elemSize;                                                         ///< Element size
+    volatile uint8_t *elements;                                                ///< Array of packets
 } ICCQueue;
 
 /**
  * Create Queue.
  * @param q pointer to uninitialized ICCQueue instance
  * @param p pointer to buffer area that is going to be assigned to the queue
- * @param length length of circular buffer
+ * @param length length of circular buffer, MUST be a power of two (rounded down if not)
  * @param elemSize element size
- * @return pointer to Queue instance OR NULL on failure
  */
-void  iccq_create(ICCQueue * q, volatile uint8_t * p, uint32_t length, uint32_t elemSize);
+void iccq_create(ICCQueue *q, volatile uint8_t *p, uint32_t length, uint32_t elemSize);
 
 /**
  * Create Queue based on storage type.
  */
-#define ICCQ_CREATE_T(length,T) iccq_create((length), sizeof(T))
+#define ICCQ_CREATE_T(q, p, length, T) iccq_create((q), (p), (length), sizeof(T))
 
 /**
  * Clear circular buffer.
  * @param q pointer to Queue
  */
-void iccq_clear(ICCQueue * q);
+void iccq_clear(ICCQueue *q);
+
+/**
+ * Clear the statistics. Not synchronized with the producer and the consumer.
+ * @param q pointer to Queue
+ */
+void iccq_clear_stats(ICCQueue *q);
 
 /**
  * Get number of available elements.
  * @param q pointer to Queue
- * @return number of available elements
+ * @return number of available elements (including padding of a wrapped reservation)
  */
-uint32_t iccq_avail(const ICCQueue * q);
+uint32_t iccq_avail(const ICCQueue *q);
+
+/**
+ * Get number of free element slots.
+ * @param q pointer to Queue
+ * @return number of free slots
+ */
+uint32_t iccq_free(const ICCQueue *q);
 
 /**
  * Push element to the Queue.
@@ -49,19 +78,63 @@ uint32_t iccq_avail(const ICCQueue * q);
  * @param raw pointer to raw packet
  * @return true on success, false on failure (e.g.: queue full)
  */
-bool iccq_push(ICCQueue * q, const void * src);
+bool iccq_push(ICCQueue *q, const void *src);
+
+/**
+ * Push multiple elements to the Queue.
+ * @param q pointer to Queue
+ * @param src pointer to the array of elements
+ * @param n number of elements attempted to be pushed
+ * @return number of elements pushed (might be less than n if the queue gets full)
+ */
+uint32_t iccq_push_n(ICCQueue *q, const void *src, uint32_t n);
 
 /**
  * Get top element.
  * @param q pointer to Queue
  * @return top element (COPY, NOT POINTER!)
  */
-void iccq_top(ICCQueue * q, void * dest);
+void iccq_top(ICCQueue *q, void *dest);
 
 /**
  * Pop top element.
  * @param q pointer to Queue
  */
-void iccq_pop(ICCQueue * q);
+void iccq_pop(ICCQueue *q);
+
+/**
+ * Pop multiple elements.
+ * @param q pointer to Queue
+ * @param dest pointer to the destination array, if NULL, then elements are discarded without copying
+ * @param n maximum number of elements to pop
+ * @return number of elements popped
+ */
+uint32_t iccq_pop_n(ICCQueue *q, void *dest, uint32_t n);
+
+/**
+ * Get the longest contiguous readable block without copying.
+ * Release the block by calling iccq_pop_n(q, NULL, n) once processed.
+ * @param q pointer to Queue
+ * @param pp pointer to a pointer getting set to the beginning of the block
+ * @return number of elements in the block
+ */
+uint32_t iccq_peek_contig(ICCQueue *q, const void **pp);
+
+/**
+ * Reserve a contiguous writable block in the Queue.
+ * The reserved elements are not visible to the consumer until iccq_commit() is called.
+ * If the tail of the element area is too short, the block is placed at the beginning.
+ * @param q pointer to Queue
+ * @param n number of elements to reserve
+ * @return pointer to the reserved block OR NULL if no contiguous block of n elements is available
+ */
+void *iccq_reserve(ICCQueue *q, uint32_t n);
+
+/**
+ * Commit (a part of) the lastly reserved block.
+ * @param q pointer to Queue
+ * @param n number of elements actually written, MUST NOT exceed the reserved count
+ */
+void iccq_commit(ICCQueue *q, uint32_t n);
 
 #endif /* ICC_ICC_QUEUE */
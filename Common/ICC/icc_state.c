@@ -0,0 +1,61 @@
+#include "icc_state.h"
+#include "icc.h"
+
+#include <string.h>
+
+#include <stm32h7xx_hal.h>
+
+extern ICC_SharedData sharedData;
+
+#define STATE (sharedData.state)
+
+void icc_state_init() {
+    memset((void *)&STATE, 0, sizeof(ICC_SharedState));
+    STATE.data.version = ICC_STATE_VERSION;
+    STATE.data.size = sizeof(ICC_StateSnapshot);
+}
+
+// -------
+
+static uint32_t savedPrimask; // interrupt mask before the update
+
+ICC_StateSnapshot * icc_state_write_begin() {
+    // exclude other writers on this core
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    savedPrimask = primask;
+
+    // mark the snapshot as being updated, the counter must be visible before any data change
+    STATE.seq++;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    return &STATE.data;
+}
+
+void icc_state_write_end() {
+    // data changes must be visible before the counter gets even again
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    STATE.seq++;
+
+    __set_PRIMASK(savedPrimask);
+}
+
+// -------
+
+bool icc_state_try_read(ICC_StateSnapshot *s) {
+    uint32_t seqBegin = __atomic_load_n(&STATE.seq, __ATOMIC_ACQUIRE);
+    if (seqBegin & 1) { // update in progress
+        return false;
+    }
+
+    memcpy(s, &STATE.data, sizeof(ICC_StateSnapshot));
+
+    // the copy must complete before the counter is checked again
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return STATE.seq == seqBegin;
+}
+
+void icc_state_read(ICC_StateSnapshot *s) {
+    while (!icc_state_try_read(s)) {
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef ICC_ICC_STATE
+#define ICC_ICC_STATE
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ICC_STATE_VERSION (1) // layout version of ICC_StateSnapshot, MUST be increased on every layout change
+
+/**
+ * Servo states.
+ */
+typedef enum {
+    ICC_SERVO_INACTIVE, ///< Servo has not run since the last reset
+    ICC_SERVO_TRACKING, ///< Servo is running, offset is above the lock threshold
+    ICC_SERVO_LOCKED    ///< Servo is running, offset is below the lock threshold
+} ICC_ServoState;
+
+#define ICC_SERVO_LOCK_THRESHOLD_NS (1000) // absolute offset below which the servo is considered locked
+
+/**
+ * CM4 state published to the CM7 core.
+ */
+typedef struct {
+    uint16_t version;     ///< Layout version (ICC_STATE_VERSION)
+    uint16_t size;        ///< Size of the snapshot structure
+    uint32_t syncCnt;     ///< Number of servo runs (sync cycles) since startup
+    int32_t ptpOffsetNs;  ///< Last master-slave time difference fed into the servo [ns]
+    uint32_t ptpAddend;   ///< PTP clock addend
+    float servoOutputPpb; ///< Last servo output (clock tuning) [ppb]
+    uint8_t servoState;   ///< Servo state (ICC_ServoState)
+    uint8_t linkUp;       ///< Ethernet link is up
+    uint16_t linkSpeed;   ///< Ethernet link speed [Mbps]
+    uint32_t ipAddr;      ///< IPv4 address acquired by DHCP as stored by the network stack, 0 if none
+} ICC_StateSnapshot;
+
+/**
+ * Seqlock-protected snapshot. The sequence counter is odd while an update is in progress.
+ */
+typedef struct {
+    volatile uint32_t seq;  ///< Sequence counter
+    ICC_StateSnapshot data; ///< Snapshot data
+} ICC_SharedState;
+
+// ------ CM7 ONLY --------
+
+/**
+ * Initialize the shared state.
+ */
+void icc_state_init();
+
+// ------ CM4 ONLY --------
+
+/**
+ * Begin updating the shared state. Wait-free and O(1), can be called from any context.
+ * Interrupts are masked until icc_state_write_end() is called, calls MUST NOT be nested.
+ * @return pointer to the snapshot to be modified in place
+ */
+ICC_StateSnapshot * icc_state_write_begin();
+
+/**
+ * Finish updating the shared state and publish it.
+ */
+void icc_state_write_end();
+
+// ------ IMPLEMENTED ON BOTH CORES --------
+
+/**
+ * Make one attempt to copy a consistent snapshot. Wait-free, does not block the writer.
+ * @param s pointer to the destination snapshot
+ * @return true if the copy is consistent, false if an update interfered
+ */
+bool icc_state_try_read(ICC_StateSnapshot *s);
+
+/**
+ * Copy a consistent snapshot, retry while updates interfere.
+ * @param s pointer to the destination snapshot
+ */
+void icc_state_read(ICC_StateSnapshot *s);
+
+#endif /* ICC_ICC_STATE */
@@ -0,0 +1,110 @@
+#include "icc_ts.h"
+#include "icc.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <stm32h7xx_hal.h>
+
+#include <cmsis_os2.h>
+
+// records never straddle the wrap-around
+_Static_assert((ICC_TELEMETRY_QUEUE_LENGTH % sizeof(ICC_TsRecord)) == 0, "telemetry queue length must be a multiple of the record size");
+
+#ifdef CORE_CM7
+
+// ------ CONSUMER --------
+
+#define ICC_TS_EVT_FLAG (0x01) // records have arrived
+
+static ICC_TsSink tsSink = NULL;      // sink function
+static osEventFlagsId_t tsEvt = NULL; // record arrival signal
+
+// called from the HSEM interrupt, the records are processed in task context
+static void icc_ts_recv_cb(ICC_ChannelId ch, ICCQueue *q) {
+    osEventFlagsSet(tsEvt, ICC_TS_EVT_FLAG);
+}
+
+static void icc_ts_thread(void *arg) {
+    ICCQueue *q = icc_get_channel(ICC_CH_TELEMETRY);
+    while (true) {
+        osEventFlagsWait(tsEvt, ICC_TS_EVT_FLAG, osFlagsWaitAny, osWaitForever);
+
+        const void *p;
+        while (iccq_peek_contig(q, &p) >= sizeof(ICC_TsRecord)) {
+            ICC_TsRecord rec;
+            memcpy(&rec, p, sizeof(ICC_TsRecord)); // release the slot before the sink runs
+            iccq_pop_n(q, NULL, sizeof(ICC_TsRecord));
+
+            if (rec.version == ICC_TS_RECORD_VERSION) {
+                tsSink(&rec);
+            }
+        }
+    }
+}
+
+void icc_ts_set_sink(ICC_TsSink sink) {
+    tsSink = sink;
+
+    if (tsEvt == NULL) {
+        tsEvt = osEventFlagsNew(NULL);
+
+        osThreadAttr_t attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.stack_size = 1024;
+        attr.name = "tsrec";
+        osThreadNew(icc_ts_thread, NULL, &attr);
+
+        icc_register_recv_cb(ICC_CH_TELEMETRY, icc_ts_recv_cb);
+    }
+}
+
+#else
+
+// ------ PRODUCER --------
+
+static bool tsEnabled = false; // stream is enabled
+static uint32_t tsSeq = 0;     // sequence ID of the next record
+static uint32_t tsStart;       // cycle counter at icc_ts_begin()
+static ICC_TsStats tsStats;    // producer statistics
+
+void icc_ts_enable(bool en) {
+    tsEnabled = en;
+}
+
+bool icc_ts_is_enabled() {
+    return tsEnabled;
+}
+
+ICC_TsRecord * icc_ts_begin() {
+    tsStart = DWT->CYCCNT;
+    uint32_t seq = tsSeq++; // drops show up as gaps
+
+    ICC_TsRecord *rec;
+    if ((!tsEnabled) || ((rec = (ICC_TsRecord *)iccq_reserve(icc_get_channel(ICC_CH_TELEMETRY), sizeof(ICC_TsRecord))) == NULL)) {
+        tsStats.dropped++;
+        return NULL;
+    }
+
+    rec->version = ICC_TS_RECORD_VERSION;
+    rec->size = sizeof(ICC_TsRecord);
+    rec->seq = seq;
+    rec->dropped = tsStats.dropped;
+    return rec;
+}
+
+void icc_ts_commit(ICC_TsRecord *rec) {
+    iccq_commit(icc_get_channel(ICC_CH_TELEMETRY), sizeof(ICC_TsRecord));
+    icc_notify_channel(ICC_CH_TELEMETRY);
+
+    uint32_t cycles = DWT->CYCCNT - tsStart;
+    tsStats.pushed++;
+    tsStats.lastCycles = cycles;
+    tsStats.maxCycles = (cycles > tsStats.maxCycles) ? cycles : tsStats.maxCycles;
+}
+
+const ICC_TsStats * icc_ts_get_stats() {
+    return &tsStats;
+}
+
+#endif
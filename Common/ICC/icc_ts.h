@@ -0,0 +1,92 @@
+#ifndef ICC_ICC_TS
+#define ICC_ICC_TS
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ICC_TS_RECORD_VERSION (2) // layout version of ICC_TsRecord, MUST be increased on every layout change
+
+/**
+ * Timestamp in a record.
+ */
+typedef struct {
+    uint32_t sec;     ///< Seconds (lower 32 bits)
+    uint32_t nanosec; ///< Nanoseconds
+} ICC_TsTime;
+
+/**
+ * Sync cycle record, streamed through the telemetry channel as is (64 bytes, never straddles the queue's wrap-around).
+ */
+typedef struct {
+    uint16_t version;     ///< Layout version (ICC_TS_RECORD_VERSION)
+    uint16_t size;        ///< Size of the record structure
+    uint32_t seq;         ///< Sequence ID of the sync cycle, consecutive records differ by one
+    ICC_TsTime t[4];      ///< Timestamps t1..t4
+    uint32_t reserved[2]; ///< Unused (zero), keeps the record 64 bytes long
+    int32_t offsetNs;     ///< Master-slave time difference fed into the servo [ns]
+    float servoOutputPpb; ///< Servo output (clock tuning) [ppb]
+    uint32_t addend;      ///< PTP clock addend after the servo run
+    uint32_t dropped;     ///< Number of records dropped by the producer so far (queue full or stream disabled)
+} ICC_TsRecord;
+
+/**
+ * Producer statistics.
+ */
+typedef struct {
+    uint32_t pushed;     ///< Number of records committed
+    uint32_t dropped;    ///< Number of records dropped (queue full or stream disabled)
+    uint32_t lastCycles; ///< Cost of the last begin-commit sequence [CPU cycles]
+    uint32_t maxCycles;  ///< Maximum cost of a begin-commit sequence [CPU cycles]
+} ICC_TsStats;
+
+/**
+ * Record sink on the CM7 core, called in task context in stream order.
+ * @param rec pointer to the record, only valid during the call
+ */
+typedef void (*ICC_TsSink)(const ICC_TsRecord *rec);
+
+// ------ CM7 ONLY --------
+
+/**
+ * Set the sink consuming the records and start the consumer task.
+ * MUST be called before icc_open_pipe().
+ * @param sink sink function
+ */
+void icc_ts_set_sink(ICC_TsSink sink);
+
+// ------ CM4 ONLY --------
+
+/**
+ * Enable or disable the record stream. Records pushed while disabled are dropped.
+ * @param en enable
+ */
+void icc_ts_enable(bool en);
+
+/**
+ * Get whether the record stream is enabled.
+ * @return stream is enabled
+ */
+bool icc_ts_is_enabled();
+
+/**
+ * Begin a record in place in the queue. Never blocks, returns NULL (and counts a drop)
+ * if the stream is disabled or the queue is full. Fields other than version, size, seq
+ * and dropped must be filled in before calling icc_ts_commit().
+ * MUST be called from a single task.
+ * @return pointer to the record or NULL
+ */
+ICC_TsRecord * icc_ts_begin();
+
+/**
+ * Pass the record to the CM7 core.
+ * @param rec pointer to the record obtained by icc_ts_begin()
+ */
+void icc_ts_commit(ICC_TsRecord *rec);
+
+/**
+ * Get the producer statistics.
+ * @return pointer to the statistics
+ */
+const ICC_TsStats * icc_ts_get_stats();
+
+#endif /* ICC_ICC_TS */